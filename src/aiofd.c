@@ -27,7 +27,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include "debug.h"
 #include "macros.h"
@@ -41,6 +44,21 @@
 extern evt_loop_t *el;
 #endif
 
+#ifndef IOV_MAX
+#define IOV_MAX (1024)
+#endif
+
+/* results of writing the queue */
+#define AIOFD_WQ_DONE   (0)   /* the queue is empty */
+#define AIOFD_WQ_AGAIN  (1)   /* the fd is full */
+#define AIOFD_WQ_ERROR  (2)   /* the write failed */
+#define AIOFD_WQ_GONE   (3)   /* a callback deleted the aiofd */
+
+/* max number of free write records kept around for reuse */
+#define AIOFD_POOL_MAX (64)
+
+typedef struct aiofd_write_s aiofd_write_t;
+
 struct aiofd_s
 {
   int         wfd;      /* read/write fd, if only one given, write-only otherwise */
@@ -50,16 +68,35 @@ struct aiofd_s
   evt_t      *revt;     /* read event */
   cb_t       *cb;       /* callback maanger */
   cb_t       *int_cb;   /* internall callback manager */
+  aiofd_ops_t const *ops; /* typed hooks, used instead of cb when set */
+  void       *ctx;      /* context passed to the ops */
+  int_t       datagram; /* each queued write is its own message */
+  evt_loop_t *el;       /* loop the events were last started on */
+  int_t       wactive;  /* is the write event started? */
+  int         werr;     /* error from a write, not yet reported */
+  int_t      *alive;    /* cleared if deleted while the queue is being written */
+  aiofd_write_t *pool;  /* free write records */
+  size_t      npool;    /* number of records in the pool */
+  size_t      hits;     /* writes that reused a pooled record */
+  size_t      misses;   /* writes that had to allocate a record */
+  int_t       listen;   /* is this a listening fd? */
+  uint8_t    *rbuf;     /* read buffer, only used in buffered read mode */
+  size_t      rsize;    /* size of the read buffer */
+  size_t      rmin;     /* least amount of space to read into */
+  size_t      rstart;   /* offset of the first unconsumed byte */
+  size_t      rend;     /* offset just past the last unconsumed byte */
 };
 
-typedef struct aiofd_write_s
+struct aiofd_write_s
 {
   void const    *data;  /* data to write */
   struct iovec const *iov; /* iovec to write */
   size_t      size;     /* size of buffer to write */
+  size_t      total;    /* total number of bytes to write */
   size_t      nleft;    /* amount left to write */
   void       *wd;       /* per-write data to pass to low-level io fn */
-} aiofd_write_t;
+  aiofd_write_t *next;  /* next record in the free pool */
+};
 
 uint8_t const * const aiofd_cb[AIOFD_CB_COUNT] =
 {
@@ -73,29 +110,52 @@ uint8_t const * const aiofd_cb[AIOFD_CB_COUNT] =
   UT("aiofd-nread-io")
 };
 
-/* helper macros for calling the callbacks */
-#define READ_EVT(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_READ_EVT), __VA_ARGS__)
-#define WRITE_EVT(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_WRITE_EVT), __VA_ARGS__)
-#define ERROR_EVT(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_ERROR_EVT), __VA_ARGS__)
-
-#define READ_IO(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_READ_IO), __VA_ARGS__)
-#define WRITE_IO(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_WRITE_IO), __VA_ARGS__)
-#define READV_IO(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_READV_IO), __VA_ARGS__)
-#define WRITEV_IO(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_WRITEV_IO), __VA_ARGS__)
-#define NREAD_IO(cb, ...) cb_call(cb, AIOFD_CB_NAME(AIOFD_NREAD_IO), __VA_ARGS__)
+/* callback ids, resolved from aiofd_cb once per process */
+static cb_id_t aiofd_cb_ids[AIOFD_CB_COUNT];
+static int_t aiofd_cb_ok = FALSE;
+static pthread_once_t aiofd_cb_once = PTHREAD_ONCE_INIT;
+#define AIOFD_CB_ID(x) (aiofd_cb_ids[x])
+
+/* helper macros for calling the callbacks, either directly through the ops
+ * or by id through the callback manager */
+#define AIOFD_CALL(a, op, id, ...) \
+  (((a)->ops != NULL) ? \
+    (((a)->ops->op != NULL) ? ((*((a)->ops->op))((a)->ctx, __VA_ARGS__), TRUE) : FALSE) : \
+    cb_call_id((a)->cb, AIOFD_CB_ID(id), __VA_ARGS__))
+
+#define READ_EVT(a, ...) AIOFD_CALL(a, read_evt, AIOFD_READ_EVT, __VA_ARGS__)
+#define WRITE_EVT(a, ...) AIOFD_CALL(a, write_evt, AIOFD_WRITE_EVT, __VA_ARGS__)
+#define ERROR_EVT(a, ...) AIOFD_CALL(a, error_evt, AIOFD_ERROR_EVT, __VA_ARGS__)
+
+#define READ_IO(a, ...) AIOFD_CALL(a, read_io, AIOFD_READ_IO, __VA_ARGS__)
+#define WRITE_IO(a, ...) AIOFD_CALL(a, write_io, AIOFD_WRITE_IO, __VA_ARGS__)
+#define READV_IO(a, ...) AIOFD_CALL(a, readv_io, AIOFD_READV_IO, __VA_ARGS__)
+#define WRITEV_IO(a, ...) AIOFD_CALL(a, writev_io, AIOFD_WRITEV_IO, __VA_ARGS__)
+#define NREAD_IO(a, ...) AIOFD_CALL(a, nread_io, AIOFD_NREAD_IO, __VA_ARGS__)
 
 /*
  * IO EVENT CALLBACKS
  */
 static void aiofd_io_evt(aiofd_t *aiofd, evt_t *evt, int fd, evt_io_type_t type);
+static void aiofd_io_fn(void *ctx, evt_t *evt, int fd, evt_io_type_t type);
 IO_CB(aiofd_io_evt, aiofd_t*);
 
 
-static int_t aiofd_init(aiofd_t *aiofd, int wfd, int rfd, cb_t *cb);
+static void aiofd_resolve_cb_ids(void);
+static int_t aiofd_init(aiofd_t *aiofd, int wfd, int rfd, cb_t *cb,
+                        aiofd_ops_t const *ops, void *ctx);
 static void aiofd_deinit(aiofd_t *aiofd);
 static int_t aiofd_write_common(aiofd_t *aiofd, void const *buf,
                                 struct iovec const * iov, size_t cnt,
                                 size_t total, void *wd);
+static int aiofd_write_queue(aiofd_t *aiofd);
+static int aiofd_write_some(aiofd_t *aiofd);
+static size_t aiofd_gather(aiofd_t *aiofd, struct iovec *iov, size_t max,
+                           size_t *nbytes);
+static int aiofd_write_msgs(aiofd_t *aiofd);
+static void aiofd_read_buffered(aiofd_t *aiofd);
+static aiofd_write_t * aiofd_get_write(aiofd_t *aiofd);
+static void aiofd_put_write(aiofd_t *aiofd, aiofd_write_t *wb);
 
 
 aiofd_t * aiofd_new(int wfd, int rfd, cb_t *cb)
@@ -107,7 +167,27 @@ aiofd_t * aiofd_new(int wfd, int rfd, cb_t *cb)
   CHECK_PTR_RET(aiofd, NULL);
 
   /* initlialize the aiofd */
-  if(!aiofd_init(aiofd, wfd, rfd, cb))
+  if(!aiofd_init(aiofd, wfd, rfd, cb, NULL, NULL))
+  {
+    FREE(aiofd);
+    return NULL;
+  }
+
+  return aiofd;
+}
+
+aiofd_t * aiofd_new_ops(int wfd, int rfd, aiofd_ops_t const *ops, void *ctx)
+{
+  aiofd_t *aiofd = NULL;
+
+  CHECK_PTR_RET(ops, NULL);
+
+  /* allocate the the aiofd struct */
+  aiofd = (aiofd_t*)CALLOC(1, sizeof(aiofd_t));
+  CHECK_PTR_RET(aiofd, NULL);
+
+  /* initlialize the aiofd */
+  if(!aiofd_init(aiofd, wfd, rfd, NULL, ops, ctx))
   {
     FREE(aiofd);
     return NULL;
@@ -127,6 +207,8 @@ void aiofd_delete(void *aio)
 
 int_t aiofd_enable_write_evt(aiofd_t *aiofd, int_t enable, evt_loop_t *el)
 {
+  aiofd_write_t *wb = NULL;
+
   CHECK_PTR_RET(aiofd, FALSE);
   CHECK_PTR_RET(aiofd->wevt, FALSE);
 
@@ -134,12 +216,25 @@ int_t aiofd_enable_write_evt(aiofd_t *aiofd, int_t enable, evt_loop_t *el)
   {
     DEBUG("starting write event\n");
     CHECK_RET(evt_start_event(aiofd->wevt, el) == EVT_OK, FALSE);
+    if(el != NULL)
+      aiofd->el = el;
   }
   else
   {
     DEBUG("stopping write event\n");
     CHECK_RET(evt_stop_event(aiofd->wevt) == EVT_OK, FALSE);
+
+    /* stopping also drops the event a direct write fed to the loop, so feed
+     * it again if that write finished or failed.  a running
+     * aiofd_write_queue reports those itself. */
+    wb = list_get_head(&(aiofd->wbuf));
+    if((aiofd->alive == NULL) && (aiofd->el != NULL) &&
+       ((aiofd->werr != 0) || ((wb != NULL) && (wb->nleft == 0))))
+    {
+      evt_feed_event(aiofd->wevt, aiofd->el);
+    }
   }
+  aiofd->wactive = enable;
   return TRUE;
 }
 
@@ -152,6 +247,8 @@ int_t aiofd_enable_read_evt(aiofd_t *aiofd, int_t enable, evt_loop_t *el)
   {
     DEBUG("starting read event\n");
     CHECK_RET(evt_start_event(aiofd->revt, el) == EVT_OK, FALSE);
+    if(el != NULL)
+      aiofd->el = el;
   }
   else
   {
@@ -172,7 +269,7 @@ ssize_t aiofd_read(aiofd_t *aiofd, void *buf, size_t n)
   CHECK_RET(n > 0, -1);
 
   /* call the low level read function */
-  CHECK_RET(READ_IO(aiofd->cb, aiofd, aiofd->rfd, buf, n, &res), -1);
+  CHECK_RET(READ_IO(aiofd, aiofd, aiofd->rfd, buf, n, &res), -1);
 
   switch (res)
   {
@@ -180,7 +277,7 @@ ssize_t aiofd_read(aiofd_t *aiofd, void *buf, size_t n)
       errno = EPIPE;
     case (ssize_t)-1:
       /* call the error event callback */
-      ERROR_EVT(aiofd->cb, NULL, aiofd, ERRNO);
+      ERROR_EVT(aiofd, NULL, aiofd, ERRNO);
       return -1;
     default:
       return res;
@@ -198,7 +295,7 @@ ssize_t aiofd_readv(aiofd_t *aiofd, struct iovec *iov, size_t iovcnt)
   CHECK_RET((iovcnt > 0), -1);
 
   /* call the low-level readv function */
-  CHECK_RET(READV_IO(aiofd->cb, aiofd, aiofd->rfd, iov, iovcnt, &res), -1);
+  CHECK_RET(READV_IO(aiofd, aiofd, aiofd->rfd, iov, iovcnt, &res), -1);
 
   switch (res)
   {
@@ -206,7 +303,7 @@ ssize_t aiofd_readv(aiofd_t *aiofd, struct iovec *iov, size_t iovcnt)
       errno = EPIPE;
     case (ssize_t)-1:
       /* call the error event callback */
-      ERROR_EVT(aiofd->cb, NULL, aiofd, ERRNO);
+      ERROR_EVT(aiofd, NULL, aiofd, ERRNO);
       return -1;
     default:
       return res;
@@ -248,6 +345,105 @@ int_t aiofd_flush(aiofd_t *aiofd)
   return TRUE;
 }
 
+int_t aiofd_set_datagram(aiofd_t *aiofd, int_t datagram)
+{
+  CHECK_PTR_RET(aiofd, FALSE);
+  aiofd->datagram = datagram;
+  return TRUE;
+}
+
+int_t aiofd_set_read_buffer(aiofd_t *aiofd, size_t size)
+{
+  uint8_t *p = NULL;
+  CHECK_PTR_RET(aiofd, FALSE);
+
+  if(size == 0)
+  {
+    /* back to telling the user how much there is to read */
+    FREE(aiofd->rbuf);
+    aiofd->rbuf = NULL;
+    aiofd->rsize = aiofd->rmin = 0;
+    aiofd->rstart = aiofd->rend = 0;
+    return TRUE;
+  }
+
+  /* never shrink below what is buffered */
+  if(size < (aiofd->rend - aiofd->rstart))
+    size = aiofd->rend - aiofd->rstart;
+
+  /* move the unconsumed bytes to the front */
+  if(aiofd->rstart > 0)
+  {
+    MEMMOVE(aiofd->rbuf, aiofd->rbuf + aiofd->rstart, aiofd->rend - aiofd->rstart);
+    aiofd->rend -= aiofd->rstart;
+    aiofd->rstart = 0;
+  }
+
+  p = (uint8_t*)REALLOC(aiofd->rbuf, size);
+  CHECK_PTR_RET(p, FALSE);
+
+  aiofd->rbuf = p;
+  aiofd->rsize = size;
+  aiofd->rmin = size;
+  return TRUE;
+}
+
+uint8_t * aiofd_read_buffer(aiofd_t *aiofd, size_t *n)
+{
+  CHECK_PTR_RET(aiofd, NULL);
+  CHECK_PTR_RET(aiofd->rbuf, NULL);
+
+  if(n)
+    (*n) = aiofd->rend - aiofd->rstart;
+  return aiofd->rbuf + aiofd->rstart;
+}
+
+int_t aiofd_read_consume(aiofd_t *aiofd, size_t n)
+{
+  CHECK_PTR_RET(aiofd, FALSE);
+  CHECK_PTR_RET(aiofd->rbuf, FALSE);
+  CHECK_RET(n <= (aiofd->rend - aiofd->rstart), FALSE);
+
+  aiofd->rstart += n;
+
+  /* rewind when everything has been consumed */
+  if(aiofd->rstart == aiofd->rend)
+    aiofd->rstart = aiofd->rend = 0;
+
+  return TRUE;
+}
+
+int_t aiofd_set_listen(aiofd_t *aiofd, int_t listen)
+{
+  CHECK_PTR_RET(aiofd, FALSE);
+  aiofd->listen = listen;
+  return TRUE;
+}
+
+int_t aiofd_get_listen(aiofd_t const *aiofd)
+{
+  CHECK_PTR_RET(aiofd, FALSE);
+  return aiofd->listen;
+}
+
+int_t aiofd_pool_stats(aiofd_t const *aiofd, size_t *hits, size_t *misses)
+{
+  CHECK_PTR_RET(aiofd, FALSE);
+  if(hits)
+    (*hits) = aiofd->hits;
+  if(misses)
+    (*misses) = aiofd->misses;
+  return TRUE;
+}
+
+cb_id_t aiofd_cb_id(aiofd_cb_t t)
+{
+  CHECK_RET(VALID_AIOFD_CB(t), CB_ID_INVALID);
+  pthread_once(&aiofd_cb_once, &aiofd_resolve_cb_ids);
+  CHECK_RET(aiofd_cb_ok, CB_ID_INVALID);
+  return aiofd_cb_ids[t];
+}
+
 
 /*
  * PRIVATE
@@ -258,8 +454,6 @@ static void aiofd_io_evt(aiofd_t *aiofd, evt_t *evt, int fd, evt_io_type_t type)
   int ret = 0;
   int_t listening = FALSE;
   size_t nread = 0;
-  ssize_t written = 0;
-  aiofd_write_t *wb = NULL;
 
   CHECK_PTR(aiofd);
   CHECK_PTR(evt);
@@ -268,94 +462,351 @@ static void aiofd_io_evt(aiofd_t *aiofd, evt_t *evt, int fd, evt_io_type_t type)
   {
     DEBUG("read event\n");
 
+    if((aiofd->rbuf != NULL) && !aiofd->listen)
+    {
+      /* read straight into our own buffer */
+      aiofd_read_buffered(aiofd);
+      return;
+    }
+
     /* get how much data is available to read */
-    NREAD_IO(aiofd->cb, aiofd, aiofd->rfd, &nread, &listening, &ret);
+    NREAD_IO(aiofd, aiofd, aiofd->rfd, &nread, &listening, &ret);
     if((ret < 0) && (listening == FALSE))
     {
       DEBUG("calling error callback\n");
-      ERROR_EVT(aiofd->cb, NULL, aiofd, ERRNO);
+      ERROR_EVT(aiofd, NULL, aiofd, ERRNO);
       return;
     }
 
     /* callback to tell client that there is data to read */
     DEBUG("calling read callback (nread = %d)\n", nread);
-    READ_EVT(aiofd->cb, aiofd, nread);
+    READ_EVT(aiofd, aiofd, nread);
   }
   else if((type & EVT_IO_WRITE) && (aiofd->wfd >= 0))
   {
     DEBUG("write event\n");
 
+    switch(aiofd_write_queue(aiofd))
+    {
+      case AIOFD_WQ_DONE:
+        /* call the write complete callback with NULL buf to signal completion */
+        WRITE_EVT(aiofd, NULL, aiofd, NULL, 0);
+        break;
+      case AIOFD_WQ_AGAIN:
+        /* a direct write hands its completion over without starting the
+         * write event, so start it now if the fd filled up */
+        if(!aiofd->wactive)
+          aiofd_enable_write_evt(aiofd, TRUE, aiofd->el);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/* writes as much of the queue as the fd will take, calling the write
+ * callback for each buffer once it has all been written and the error
+ * callback if a write fails.  the callbacks may delete the aiofd, in which
+ * case AIOFD_WQ_GONE is returned and the aiofd must not be touched. */
+static int aiofd_write_queue(aiofd_t *aiofd)
+{
+  int err = 0;
+  int ret = AIOFD_WQ_DONE;
+  int_t alive = TRUE;
+  void *wd = NULL;
+  void *buf = NULL;
+  size_t size = 0;
+  aiofd_write_t *wb = NULL;
+
+  aiofd->alive = &alive;
+
+  while(TRUE)
+  {
+    /* retire the buffers that are completely written, in order */
     while(list_count(&(aiofd->wbuf)) > 0)
     {
-      /* we must have data to write */
       wb = list_get_head(&(aiofd->wbuf));
+      if((wb != NULL) && (wb->nleft > 0))
+        break;
+
+      /* remove the write buf from the queue and put it back in the pool */
+      list_pop_head(&(aiofd->wbuf));
+      if(wb == NULL)
+        continue;
+      wd = wb->wd;
+      buf = (void*)(wb->data ? wb->data : wb->iov);
+      size = wb->size;
+      aiofd_put_write(aiofd, wb);
+
+      /* call the write complete callback to let client know that a
+       * particular buf has been written to the fd. */
+      WRITE_EVT(aiofd, wd, aiofd, buf, size);
+      if(!alive)
+        return AIOFD_WQ_GONE;
+    }
 
-      if(!wb)
-      {
-        list_pop_head(&(aiofd->wbuf));
-        DEBUG("bad write data pointer");
-        return;
-      }
+    /* report a failed write */
+    if(aiofd->werr != 0)
+    {
+      err = aiofd->werr;
+      aiofd->werr = 0;
+      wb = list_get_head(&(aiofd->wbuf));
+      ERROR_EVT(aiofd, (wb ? wb->wd : NULL), aiofd, err);
+      if(!alive)
+        return AIOFD_WQ_GONE;
+      ret = AIOFD_WQ_ERROR;
+    }
 
-      if(wb->iov)
-      {
-        /* call the low-level writev function */
-        WRITEV_IO(aiofd->cb, wb->wd, aiofd, aiofd->wfd, wb->iov, wb->size, &written);
-      }
-      else
-      {
-        /* call the low-level write function */
-        WRITE_IO(aiofd->cb, wb->wd, aiofd, aiofd->wfd, wb->data, wb->size, &written);
-      }
+    if((ret != AIOFD_WQ_DONE) || (list_count(&(aiofd->wbuf)) == 0))
+      break;
 
-      /* try to write the data to the socket */
-      if(written < 0)
-      {
-        if((ERRNO == EAGAIN) || (ERRNO == EWOULDBLOCK))
-        {
-          DEBUG("write would block...waiting for next write event\n");
-          return;
-        }
-        else
-        {
-          DEBUG("write error: %s (%d)\n", strerror(ERRNO), ERRNO);
-          ERROR_EVT(aiofd->cb, wb->wd, aiofd, ERRNO);
-          return;
-        }
-      }
-      else
-      {
-        /* decrement how many bytes are left to write */
-        wb->nleft -= written;
+    ret = aiofd_write_some(aiofd);
+  }
 
-        /* check to see if everything has been written */
-        if(wb->nleft <= 0)
-        {
-          /* remove the write buf from the queue */
-          list_pop_head(&(aiofd->wbuf));
+  aiofd->alive = NULL;
+  return ret;
+}
 
-          /* call the write complete callback to let client know that a
-           * particular buf has been written to the fd. */
-          WRITE_EVT(aiofd->cb, wb->wd, aiofd, (wb->data ? wb->data : wb->iov), wb->size);
+/* makes one write of as much of the head of the queue as can be gathered
+ * and marks what was written.  no event callbacks are made, a failure is
+ * left in werr for aiofd_write_queue to report.  returns AIOFD_WQ_DONE if
+ * everything gathered was written. */
+static int aiofd_write_some(aiofd_t *aiofd)
+{
+  struct iovec iov[IOV_MAX];
+  size_t cnt = 0;
+  size_t nbytes = 0;
+  size_t left = 0;
+  ssize_t written = 0;
+  int_t done = FALSE;
+  list_itr_t itr;
+  aiofd_write_t *wb = NULL;
+
+  /* we must have data to write */
+  wb = list_get_head(&(aiofd->wbuf));
+  CHECK_PTR_RET_MSG(wb, AIOFD_WQ_ERROR, "bad write data pointer\n");
+
+  if(aiofd->datagram && (list_count(&(aiofd->wbuf)) > 1) &&
+     (aiofd->ops != NULL) && (aiofd->ops->writem_io != NULL))
+  {
+    /* send a batch of datagrams in one call */
+    return aiofd_write_msgs(aiofd);
+  }
+
+  /* build the iovec from the queued buffers */
+  cnt = aiofd_gather(aiofd, iov, IOV_MAX, &nbytes);
 
-          /* free it */
-          FREE(wb);
+  written = -1;
+  if((cnt == 1) && (wb->iov == NULL))
+  {
+    /* call the low-level write function */
+    done = WRITE_IO(aiofd, wb->wd, aiofd, aiofd->wfd, iov[0].iov_base,
+                    iov[0].iov_len, &written);
+  }
+
+  if(!done)
+  {
+    /* call the low-level writev function */
+    done = WRITEV_IO(aiofd, wb->wd, aiofd, aiofd->wfd, iov, cnt, &written);
+  }
+
+  if(!done && (cnt > 1) && (wb->iov == NULL))
+  {
+    /* no writev hook, fall back to writing the head buffer alone */
+    nbytes = iov[0].iov_len;
+    done = WRITE_IO(aiofd, wb->wd, aiofd, aiofd->wfd, iov[0].iov_base,
+                    iov[0].iov_len, &written);
+  }
+  CHECK_RET(done, AIOFD_WQ_ERROR);
+
+  if(written < 0)
+  {
+    if((ERRNO == EAGAIN) || (ERRNO == EWOULDBLOCK))
+    {
+      DEBUG("write would block...waiting for next write event\n");
+      return AIOFD_WQ_AGAIN;
+    }
+
+    DEBUG("write error: %s (%d)\n", strerror(ERRNO), ERRNO);
+    aiofd->werr = ERRNO;
+    return AIOFD_WQ_ERROR;
+  }
+
+  /* a datagram is sent whole or not at all */
+  if(aiofd->datagram)
+    written = nbytes = wb->nleft;
+
+  /* mark off what was written, in order */
+  left = (size_t)written;
+  itr = list_itr_begin(&(aiofd->wbuf));
+  while((left > 0) && (itr != list_itr_end(&(aiofd->wbuf))))
+  {
+    wb = list_get(&(aiofd->wbuf), itr);
+    if(left < wb->nleft)
+    {
+      /* partially written, the rest goes out next time */
+      wb->nleft -= left;
+      break;
+    }
+    left -= wb->nleft;
+    wb->nleft = 0;
+    itr = list_itr_next(&(aiofd->wbuf), itr);
+  }
+
+  /* a short write means the fd is full, wait for the next write event */
+  return ((size_t)written < nbytes) ? AIOFD_WQ_AGAIN : AIOFD_WQ_DONE;
+}
+
+/* hands up to AIOFD_MSG_MAX queued datagrams to the writem_io hook and marks
+ * the ones that were sent. */
+static int aiofd_write_msgs(aiofd_t *aiofd)
+{
+  aiofd_msg_t msgs[AIOFD_MSG_MAX];
+  struct iovec bufs[AIOFD_MSG_MAX];
+  size_t cnt = 0;
+  ssize_t i, sent = -1;
+  list_itr_t itr, end;
+  aiofd_write_t *wb = NULL;
+
+  itr = list_itr_begin(&(aiofd->wbuf));
+  end = list_itr_end(&(aiofd->wbuf));
+  for(; (itr != end) && (cnt < AIOFD_MSG_MAX); itr = list_itr_next(&(aiofd->wbuf), itr))
+  {
+    wb = (aiofd_write_t*)list_get(&(aiofd->wbuf), itr);
+    if(wb == NULL)
+      break;
+
+    if(wb->iov != NULL)
+    {
+      msgs[cnt].iov = wb->iov;
+      msgs[cnt].iovcnt = wb->size;
+    }
+    else
+    {
+      bufs[cnt].iov_base = (void*)wb->data;
+      bufs[cnt].iov_len = wb->total;
+      msgs[cnt].iov = &bufs[cnt];
+      msgs[cnt].iovcnt = 1;
+    }
+    msgs[cnt].wd = wb->wd;
+    cnt++;
+  }
+  CHECK_RET(cnt > 0, AIOFD_WQ_ERROR);
+
+  (*(aiofd->ops->writem_io))(aiofd->ctx, aiofd, aiofd->wfd, msgs, cnt, &sent);
+
+  if(sent < 0)
+  {
+    if((ERRNO == EAGAIN) || (ERRNO == EWOULDBLOCK))
+    {
+      DEBUG("write would block...waiting for next write event\n");
+      return AIOFD_WQ_AGAIN;
+    }
+
+    DEBUG("write error: %s (%d)\n", strerror(ERRNO), ERRNO);
+    aiofd->werr = ERRNO;
+    return AIOFD_WQ_ERROR;
+  }
+  CHECK_RET(sent > 0, AIOFD_WQ_AGAIN);
+
+  /* mark the datagrams that were sent, in order */
+  itr = list_itr_begin(&(aiofd->wbuf));
+  for(i = 0; (i < sent) && (itr != end); i++)
+  {
+    wb = (aiofd_write_t*)list_get(&(aiofd->wbuf), itr);
+    wb->nleft = 0;
+    itr = list_itr_next(&(aiofd->wbuf), itr);
+  }
+
+  return AIOFD_WQ_DONE;
+}
+
+/* fills iov with the unwritten parts of the queued buffers, starting at the
+ * head.  datagram writes and writes with per-write data are never combined
+ * with others.  returns the number of iovec entries used. */
+static size_t aiofd_gather(aiofd_t *aiofd, struct iovec *iov, size_t max,
+                           size_t *nbytes)
+{
+  size_t i, off, cnt = 0;
+  list_itr_t itr, end;
+  aiofd_write_t *wb = NULL;
+
+  (*nbytes) = 0;
+  itr = list_itr_begin(&(aiofd->wbuf));
+  end = list_itr_end(&(aiofd->wbuf));
+  for(; itr != end; itr = list_itr_next(&(aiofd->wbuf), itr))
+  {
+    wb = (aiofd_write_t*)list_get(&(aiofd->wbuf), itr);
+    if(wb == NULL)
+      break;
+
+    if(cnt > 0)
+    {
+      /* only plain stream writes get combined */
+      if(aiofd->datagram || (wb->wd != NULL))
+        break;
+
+      /* don't split a buffer across two writev calls unless we must */
+      if((wb->iov ? wb->size : 1) > (max - cnt))
+        break;
+    }
+
+    /* skip over what has already been written */
+    off = wb->total - wb->nleft;
+    if(wb->iov == NULL)
+    {
+      iov[cnt].iov_base = (void*)((uint8_t const *)wb->data + off);
+      iov[cnt].iov_len = wb->nleft;
+      (*nbytes) += iov[cnt].iov_len;
+      cnt++;
+    }
+    else
+    {
+      for(i = 0; (i < wb->size) && (cnt < max); i++)
+      {
+        if(off >= wb->iov[i].iov_len)
+        {
+          off -= wb->iov[i].iov_len;
+          continue;
         }
+        iov[cnt].iov_base = (void*)((uint8_t const *)wb->iov[i].iov_base + off);
+        iov[cnt].iov_len = wb->iov[i].iov_len - off;
+        (*nbytes) += iov[cnt].iov_len;
+        off = 0;
+        cnt++;
       }
     }
 
-    /* call the write complete callback with NULL buf to signal completion */
-    WRITE_EVT(aiofd->cb, NULL, aiofd, NULL, 0);
+    /* datagrams and writes with per-write data go out alone */
+    if(aiofd->datagram || (wb->wd != NULL) || (cnt == max))
+      break;
   }
+
+  return cnt;
+}
+
+static void aiofd_io_fn(void *ctx, evt_t *evt, int fd, evt_io_type_t type)
+{
+  aiofd_io_evt((aiofd_t*)ctx, evt, fd, type);
 }
 
-static int_t aiofd_init(aiofd_t *aiofd, int wfd, int rfd, cb_t *cb)
+static void aiofd_resolve_cb_ids(void)
+{
+  aiofd_cb_ok = cb_ids(aiofd_cb, aiofd_cb_ids, AIOFD_CB_COUNT);
+}
+
+static int_t aiofd_init(aiofd_t *aiofd, int wfd, int rfd, cb_t *cb,
+                        aiofd_ops_t const *ops, void *ctx)
 {
   UNIT_TEST_RET(aiofd_initialize);
 
   CHECK_PTR_RET(aiofd, FALSE);
   CHECK_RET((wfd >= 0) || (rfd >= 0), FALSE);
-  CHECK_PTR_RET(cb, FALSE);
+  CHECK_RET((cb != NULL) || (ops != NULL), FALSE);
+
+  /* resolve the callback names to ids */
+  pthread_once(&aiofd_cb_once, &aiofd_resolve_cb_ids);
+  CHECK_RET(aiofd_cb_ok, FALSE);
 
   MEMSET((void*)aiofd, 0, sizeof(aiofd_t));
 
@@ -363,10 +814,30 @@ static int_t aiofd_init(aiofd_t *aiofd, int wfd, int rfd, cb_t *cb)
   aiofd->wfd = wfd;
   aiofd->rfd = rfd;
   aiofd->cb = cb;
+  aiofd->ops = ops;
+  aiofd->ctx = ctx;
 
   /* initialize the write buf */
   CHECK_RET(list_init(&(aiofd->wbuf), 8, FREE), FALSE);
 
+  if(ops != NULL)
+  {
+    /* with typed ops the io events call straight into us, no cb_t needed */
+    if(wfd >= 0)
+    {
+      aiofd->wevt = evt_new_io_event_fn(&aiofd_io_fn, aiofd, wfd, EVT_IO_WRITE);
+      CHECK_GOTO(aiofd->wevt, _aiofd_init_3);
+    }
+
+    if(rfd >= 0)
+    {
+      aiofd->revt = evt_new_io_event_fn(&aiofd_io_fn, aiofd, rfd, EVT_IO_READ);
+      CHECK_GOTO(aiofd->revt, _aiofd_init_1);
+    }
+
+    return TRUE;
+  }
+
   /* create internal */
   aiofd->int_cb = cb_new();
   CHECK_GOTO(aiofd->int_cb, _aiofd_init_3);
@@ -402,10 +873,127 @@ _aiofd_init_3:
 
 static void aiofd_deinit(aiofd_t *aiofd)
 {
+  aiofd_write_t *wb = NULL;
+
+  /* let a running aiofd_write_queue know it must stop */
+  if(aiofd->alive != NULL)
+    (*(aiofd->alive)) = FALSE;
+
   evt_delete_event(aiofd->revt);
   evt_delete_event(aiofd->wevt);
   cb_delete(aiofd->int_cb);
   list_deinit(&(aiofd->wbuf));
+  FREE(aiofd->rbuf);
+
+  /* free the pooled write records */
+  while(aiofd->pool != NULL)
+  {
+    wb = aiofd->pool;
+    aiofd->pool = wb->next;
+    FREE(wb);
+  }
+  aiofd->npool = 0;
+}
+
+/* reads once into the spare space of the read buffer, growing it if there
+ * isn't at least rmin bytes of room, then tells the user how many unconsumed
+ * bytes there are.  zero means the other end closed. */
+static void aiofd_read_buffered(aiofd_t *aiofd)
+{
+  ssize_t ret = -1;
+  size_t used = aiofd->rend - aiofd->rstart;
+  size_t size = aiofd->rsize;
+  uint8_t *p = NULL;
+
+  if((aiofd->rsize - aiofd->rend) < aiofd->rmin)
+  {
+    /* move the unconsumed bytes to the front */
+    if(aiofd->rstart > 0)
+    {
+      MEMMOVE(aiofd->rbuf, aiofd->rbuf + aiofd->rstart, used);
+      aiofd->rstart = 0;
+      aiofd->rend = used;
+    }
+
+    /* still not enough room, so double the buffer */
+    while((size - used) < aiofd->rmin)
+      size *= 2;
+
+    if(size != aiofd->rsize)
+    {
+      p = (uint8_t*)REALLOC(aiofd->rbuf, size);
+      if(p == NULL)
+      {
+        DEBUG("failed to grow the read buffer\n");
+        ERROR_EVT(aiofd, NULL, aiofd, ENOMEM);
+        return;
+      }
+      aiofd->rbuf = p;
+      aiofd->rsize = size;
+    }
+  }
+
+  /* call the low level read function */
+  CHECK(READ_IO(aiofd, aiofd, aiofd->rfd, aiofd->rbuf + aiofd->rend,
+                aiofd->rsize - aiofd->rend, &ret));
+
+  if(ret < 0)
+  {
+    if((ERRNO == EAGAIN) || (ERRNO == EWOULDBLOCK))
+      return;
+
+    DEBUG("calling error callback\n");
+    ERROR_EVT(aiofd, NULL, aiofd, ERRNO);
+    return;
+  }
+
+  if(ret == 0)
+  {
+    /* the other end closed */
+    READ_EVT(aiofd, aiofd, 0);
+    return;
+  }
+
+  aiofd->rend += (size_t)ret;
+
+  /* callback to tell client how much data is buffered */
+  DEBUG("calling read callback (buffered = %d)\n", aiofd->rend - aiofd->rstart);
+  READ_EVT(aiofd, aiofd, aiofd->rend - aiofd->rstart);
+}
+
+/* get a write record from the pool, allocating one if the pool is empty */
+static aiofd_write_t * aiofd_get_write(aiofd_t *aiofd)
+{
+  aiofd_write_t *wb = NULL;
+
+  if(aiofd->pool != NULL)
+  {
+    wb = aiofd->pool;
+    aiofd->pool = wb->next;
+    aiofd->npool--;
+    aiofd->hits++;
+    MEMSET((void*)wb, 0, sizeof(aiofd_write_t));
+    return wb;
+  }
+
+  aiofd->misses++;
+  return (aiofd_write_t*)CALLOC(1, sizeof(aiofd_write_t));
+}
+
+/* return a write record to the pool, freeing it if the pool is full */
+static void aiofd_put_write(aiofd_t *aiofd, aiofd_write_t *wb)
+{
+  CHECK_PTR(wb);
+
+  if(aiofd->npool >= AIOFD_POOL_MAX)
+  {
+    FREE(wb);
+    return;
+  }
+
+  wb->next = aiofd->pool;
+  aiofd->pool = wb;
+  aiofd->npool++;
 }
 
 /* queue up data to write to the fd */
@@ -422,7 +1010,7 @@ static int_t aiofd_write_common(aiofd_t *aiofd, void const *buf,
     CHECK_RET(cnt > 0, FALSE);
     CHECK_RET(total > 0, FALSE);
 
-    wb = CALLOC(1, sizeof(aiofd_write_t));
+    wb = aiofd_get_write(aiofd);
     if(wb == NULL)
     {
         DEBUG("failed to allocate write buf struct\n");
@@ -433,16 +1021,38 @@ static int_t aiofd_write_common(aiofd_t *aiofd, void const *buf,
     wb->data = buf;
     wb->iov = iov;
     wb->size = cnt;
+    wb->total = total;
     wb->nleft = total;
     wb->wd = wd;
 
     /* queue the write */
     CHECK_GOTO(list_push_tail(&(aiofd->wbuf), wb), _aiofd_wcom);
 
+    /* if nothing was waiting and the write event isn't running, try to write
+     * it right now.  no callbacks are made from here, the loop makes them on
+     * its next pass just as if the write event had fired, and the write event
+     * is only started if the fd is full.  this needs to know the loop, so it
+     * only happens once an event was started, and not while the queue is
+     * already being written by a callback's caller. */
+    if((list_count(&(aiofd->wbuf)) == 1) && (aiofd->el != NULL) &&
+       !aiofd->wactive && (aiofd->alive == NULL))
+    {
+        if(aiofd_write_some(aiofd) == AIOFD_WQ_AGAIN)
+        {
+            DEBUG("fd is full, starting write event\n");
+            aiofd_enable_write_evt(aiofd, TRUE, aiofd->el);
+        }
+        else
+        {
+            /* written or failed, either way the loop tells the user */
+            evt_feed_event(aiofd->wevt, aiofd->el);
+        }
+    }
+
     return TRUE;
 
 _aiofd_wcom:
-    FREE(wb);
+    aiofd_put_write(aiofd, wb);
     return FALSE;
 }
 
@@ -810,6 +1420,10 @@ void test_aiofd_write_common(void)
 
 void test_aiofd_private_functions(void)
 {
+  /* the ids are resolved once and match the names */
+  CU_ASSERT_EQUAL(aiofd_cb_id(AIOFD_WRITE_EVT), cb_id(aiofd_cb[AIOFD_WRITE_EVT]));
+  CU_ASSERT_EQUAL(AIOFD_CB_ID(AIOFD_NREAD_IO), cb_id(aiofd_cb[AIOFD_NREAD_IO]));
+  CU_ASSERT_EQUAL(aiofd_cb_id(AIOFD_CB_COUNT), CB_ID_INVALID);
   /*
     test_aiofd_write_fn();
     test_aiofd_read_fn();
@@ -53,6 +53,9 @@ typedef enum aiofd_cb_e
 extern uint8_t const * const aiofd_cb[AIOFD_CB_COUNT];
 #define AIOFD_CB_NAME(x) (VALID_AIOFD_CB(x) ? aiofd_cb[x] : NULL)
 
+/* get the callback id for an aiofd callback, resolved once per process */
+cb_id_t aiofd_cb_id(aiofd_cb_t t);
+
 /* helper macros for declaring and adding aiofd callbacks */
 #define READ_EVT_CB(fn,ctx) CB_2(fn,ctx,aiofd_t*,size_t)
 #define WRITE_EVT_CB(fn,ctx,wd) CB_4(fn,ctx,wd,aiofd_t*,void*,size_t)
@@ -64,19 +67,58 @@ extern uint8_t const * const aiofd_cb[AIOFD_CB_COUNT];
 #define WRITEV_IO_CB(fn,ctx,wd) CB_6(fn,ctx,wd,aiofd_t*,int,struct iovec const*,size_t,ssize_t*)
 #define NREAD_IO_CB(fn,ctx) CB_5(fn,ctx,aiofd_t*,int,size_t*,int_t*,int*)
 
-#define ADD_READ_EVT_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_READ_EVT),fn,ctx)
-#define ADD_WRITE_EVT_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_WRITE_EVT),fn,ctx)
-#define ADD_ERROR_EVT_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_ERROR_EVT),fn,ctx)
+#define ADD_READ_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_READ_EVT),AIOFD_CB_NAME(AIOFD_READ_EVT),fn,ctx)
+#define ADD_WRITE_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_WRITE_EVT),AIOFD_CB_NAME(AIOFD_WRITE_EVT),fn,ctx)
+#define ADD_ERROR_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_ERROR_EVT),AIOFD_CB_NAME(AIOFD_ERROR_EVT),fn,ctx)
 
-#define ADD_READ_IO_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_READ_IO),fn,ctx)
-#define ADD_WRITE_IO_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_WRITE_IO),fn,ctx)
-#define ADD_READV_IO_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_READV_IO),fn,ctx)
-#define ADD_WRITEV_IO_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_WRITEV_IO),fn,ctx)
-#define ADD_NREAD_IO_CB(cb,fn,ctx) ADD_CB(cb,AIOFD_CB_NAME(AIOFD_NREAD_IO),fn,ctx)
+#define ADD_READ_IO_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_READ_IO),AIOFD_CB_NAME(AIOFD_READ_IO),fn,ctx)
+#define ADD_WRITE_IO_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_WRITE_IO),AIOFD_CB_NAME(AIOFD_WRITE_IO),fn,ctx)
+#define ADD_READV_IO_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_READV_IO),AIOFD_CB_NAME(AIOFD_READV_IO),fn,ctx)
+#define ADD_WRITEV_IO_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_WRITEV_IO),AIOFD_CB_NAME(AIOFD_WRITEV_IO),fn,ctx)
+#define ADD_NREAD_IO_CB(cb,fn,ctx) ADD_CB_ID(cb,aiofd_cb_id(AIOFD_NREAD_IO),AIOFD_CB_NAME(AIOFD_NREAD_IO),fn,ctx)
 
 typedef struct aiofd_s aiofd_t;
 
+/* max number of datagrams handed to the writem_io hook at once */
+#define AIOFD_MSG_MAX (64)
+
+/* one queued datagram, as handed to the writem_io hook */
+typedef struct aiofd_msg_s
+{
+  struct iovec const *iov;  /* the datagram's data */
+  size_t iovcnt;            /* number of entries in iov */
+  void *wd;                 /* per-write data given to aiofd_write/writev */
+} aiofd_msg_t;
+
+/* typed alternative to the callbacks above.  an aiofd created with
+ * aiofd_new_ops() calls these directly, passing ctx as the first parameter,
+ * instead of dispatching through a cb_t.  the parameters match the *_CB
+ * macros above.  any hook may be NULL. */
+typedef struct aiofd_ops_s
+{
+  void (*read_evt)(void *ctx, aiofd_t *aiofd, size_t nread);
+  void (*write_evt)(void *ctx, void *wd, aiofd_t *aiofd, void *buf, size_t n);
+  void (*error_evt)(void *ctx, void *wd, aiofd_t *aiofd, int err);
+
+  void (*read_io)(void *ctx, aiofd_t *aiofd, int fd, void *buf, size_t n,
+                  ssize_t *res);
+  void (*write_io)(void *ctx, void *wd, aiofd_t *aiofd, int fd,
+                   void const *buf, size_t n, ssize_t *res);
+  void (*readv_io)(void *ctx, aiofd_t *aiofd, int fd, struct iovec *iov,
+                   size_t iovcnt, ssize_t *res);
+  void (*writev_io)(void *ctx, void *wd, aiofd_t *aiofd, int fd,
+                    struct iovec const *iov, size_t iovcnt, ssize_t *res);
+  void (*nread_io)(void *ctx, aiofd_t *aiofd, int fd, size_t *nread,
+                   int_t *listening, int *ret);
+
+  /* optional, datagram fds only.  sends as many of the n queued datagrams as
+   * it can in one go and sets res to the number sent, or -1 on error. */
+  void (*writem_io)(void *ctx, aiofd_t *aiofd, int fd, aiofd_msg_t const *msgs,
+                    size_t n, ssize_t *res);
+} aiofd_ops_t;
+
 aiofd_t * aiofd_new(int wfd, int rfd, cb_t *cb);
+aiofd_t * aiofd_new_ops(int wfd, int rfd, aiofd_ops_t const *ops, void *ctx);
 void aiofd_delete(void *aio);
 
 /* enables/disables processing of the read and write events */
@@ -89,7 +131,24 @@ ssize_t aiofd_read(aiofd_t *aiofd, void *buf, size_t n);
 /* read from fd into iovec (scatter input) */
 ssize_t aiofd_readv(aiofd_t *aiofd, struct iovec *iov, size_t iovcnt);
 
-/* write data to the fd */
+/* switch to buffered reads.  on each read event the aiofd does one read into
+ * its own buffer, which starts at size bytes and grows as needed, and the read
+ * callback gets the number of unconsumed bytes instead of the number waiting
+ * on the fd.  a count of 0 means the other end closed.  size 0 switches back
+ * to unbuffered reads. */
+int_t aiofd_set_read_buffer(aiofd_t *aiofd, size_t size);
+
+/* get the unconsumed bytes in the read buffer, valid until the next read
+ * event or consume */
+uint8_t * aiofd_read_buffer(aiofd_t *aiofd, size_t *n);
+
+/* drop n bytes from the front of the read buffer */
+int_t aiofd_read_consume(aiofd_t *aiofd, size_t n);
+
+/* write data to the fd.  once one of the events has been started on a loop,
+ * a write to an idle fd goes out immediately and the write event is only
+ * started if the fd can't take all of it.  the write and error callbacks are
+ * never called from inside this, they come from the loop either way. */
 int_t aiofd_write(aiofd_t *aiofd, void const *buf, size_t n, void *wd);
 
 /* write iovec to the fd (gather output) */
@@ -98,6 +157,15 @@ int_t aiofd_writev(aiofd_t *aiofd, struct iovec const *iov, size_t iovcnt, void
 /* flush the fd output */
 int_t aiofd_flush(aiofd_t *aiofd);
 
+/* mark the fd as message oriented (e.g. UDP) so that queued writes are
+ * never merged into one writev.  each stays a message of its own, but with a
+ * writem_io hook several queued messages can go out in one sendmmsg batch. */
+int_t aiofd_set_datagram(aiofd_t *aiofd, int_t datagram);
+
+/* get the number of writes that reused a pooled write record (hits) and the
+ * number that had to allocate one (misses) */
+int_t aiofd_pool_stats(aiofd_t const *aiofd, size_t *hits, size_t *misses);
+
 /* get/set the listening fd flag, used for bound and listening socket fd's */
 int_t aiofd_set_listen(aiofd_t *aiofd, int_t listen);
 int_t aiofd_get_listen(aiofd_t const *aiofd);
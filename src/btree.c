@@ -34,16 +34,17 @@
 #define max(x, y) ((x > y) ? x : y)
 
 
+/* the first four members must stay in the same order as bt_link_t */
 typedef struct node_s
 {
     void * key;                 /* key */
     void * val;                 /* value */
+    struct node_s * next;       /* traversal threading pointer/free list pointer */
+    struct node_s * prev;       /* traversal threading pointer */
     int32_t balance;            /* balance factor */
     struct node_s * parent;     /* parent pointer */
     struct node_s * left;       /* left child */
     struct node_s * right;      /* right child */
-    struct node_s * next;       /* traversal threading pointer/free list pointer */
-    struct node_s * prev;       /* traversal threading pointer */
 } node_t;
 
 /* the binary tree structure */
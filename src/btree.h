@@ -23,6 +23,16 @@
 /* the  iterator type */
 typedef void * bt_itr_t;
 
+/* the leading members of every tree node.  they are public so that the
+ * unchecked iteration macros can follow the threading pointers inline. */
+typedef struct bt_link_s
+{
+    void * key;                 /* key */
+    void * val;                 /* value */
+    void * next;                /* in-order successor */
+    void * prev;                /* in-order predecessor */
+} bt_link_t;
+
 /* the binary tree opaque handle */
 typedef struct bt_s bt_t;
 
@@ -90,4 +100,15 @@ void* bt_itr_get_key(
     bt_t const * const btree,
     bt_itr_t const itr);
 
+/* unchecked iteration.  these do no argument checking so itr must be a node
+ * in the tree, and the tree must not be modified inside a BT_FOREACH loop. */
+#define BT_ITR_NEXT(itr) (((bt_link_t*)(itr))->next)
+#define BT_ITR_RNEXT(itr) (((bt_link_t*)(itr))->prev)
+#define BT_ITR_GET(itr) (((bt_link_t*)(itr))->val)
+#define BT_ITR_GET_KEY(itr) (((bt_link_t*)(itr))->key)
+#define BT_FOREACH(btree, itr) \
+    for ( (itr) = bt_itr_begin( btree ); (itr) != NULL; (itr) = BT_ITR_NEXT( itr ) )
+#define BT_RFOREACH(btree, itr) \
+    for ( (itr) = bt_itr_rbegin( btree ); (itr) != NULL; (itr) = BT_ITR_RNEXT( itr ) )
+
 #endif
@@ -25,6 +25,7 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #define DEBUG_ON
 
@@ -42,22 +43,35 @@
 struct cb_s
 {
   ht_t*   ht;
+  list_t** lists;   /* bucket lists indexed by cb_id_t */
+  cb_id_t nlists;
 #ifdef DEBUG
   uint64_t cb_calls;
 #endif
 };
 
+/* process-wide name -> id registry */
+static ht_t * cb_names = NULL;
+static cb_id_t cb_next_id = (CB_ID_INVALID + 1);
+static pthread_mutex_t cb_names_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* forward declare the helper functions */
 static int_t cb_init(cb_t *cb);
 static void cb_deinit(cb_t *cb);
+static cb_id_t intern_name(uint8_t const * const name);
+static int_t grow_lists(cb_t * cb, cb_id_t id);
+static int_t call_list(cb_t * cb, list_t * l, va_list args);
 static pair_t* find_bucket(ht_t * ht, uint8_t const * const name);
 static list_itr_t get_cb_itr(list_t * l, void * ctx, cbfn fn);
 static pair_t* find_cb(list_t * l, void * ctx, cbfn fn);
 static int_t remove_cb(list_t * l, void * ctx, cbfn fn);
 
+static uint_t fnv_key_hash(void const * const key);
 static uint_t cb_hash_fn(void const * const key);
 static int_t cb_match_fn(void const * const l, void const * const r);
+static int_t cb_name_match_fn(void const * const name, void const * const bkt);
 static void cb_delete_fn(void * p);
+static void cb_delete_name_fn(void * p);
 
 cb_t* cb_new(void)
 {
@@ -96,6 +110,16 @@ int_t cb_has(cb_t * cb, uint8_t const * const name)
 }
 
 int_t cb_add(cb_t * cb, uint8_t const * const name, void * ctx, cbfn fn)
+{
+  CHECK_PTR_RET(cb, FALSE);
+  CHECK_PTR_RET(name, FALSE);
+  CHECK_PTR_RET(fn, FALSE);
+
+  /* intern the name, this is the only add that needs the registry lock */
+  return cb_add_id(cb, cb_id(name), name, ctx, fn);
+}
+
+int_t cb_add_id(cb_t * cb, cb_id_t id, uint8_t const * const name, void * ctx, cbfn fn)
 {
   int_t add = FALSE;
   pair_t * bkt = NULL;
@@ -109,6 +133,7 @@ int_t cb_add(cb_t * cb, uint8_t const * const name, void * ctx, cbfn fn)
   CHECK_PTR_RET(cb, FALSE);
   CHECK_PTR_RET(name, FALSE);
   CHECK_PTR_RET(fn, FALSE);
+  CHECK_RET(id > CB_ID_INVALID, FALSE);
 
   bkt = find_bucket(cb->ht, name);
   l = pair_second(bkt);
@@ -118,6 +143,9 @@ int_t cb_add(cb_t * cb, uint8_t const * const name, void * ctx, cbfn fn)
   if (p != NULL)
     return FALSE;
 
+  /* make sure there is a slot for the id before changing anything */
+  CHECK_RET(grow_lists(cb, id), FALSE);
+
   /* allocate a new bucket if needed */
   if ((l == NULL) && (bkt == NULL))
   {
@@ -144,6 +172,9 @@ int_t cb_add(cb_t * cb, uint8_t const * const name, void * ctx, cbfn fn)
   {
     /* add it to the ht, on fail, goto 3 so we don't double free r */
     CHECK_GOTO(ht_insert(cb->ht, bkt), _cb_add_fail3);
+
+    /* the ht owns the list, the id array just points at it */
+    cb->lists[id] = l;
   }
 
   /* allocate a new pair */
@@ -179,10 +210,6 @@ int_t cb_call(cb_t * cb, uint8_t const * const name, ...)
   int_t ret = FALSE;
   pair_t * bkt = NULL;
   list_t * l = NULL;
-  pair_t * p = NULL;
-  list_itr_t itr, end;
-  void * ctx = NULL;
-  cbfn fn = NULL;
 
   CHECK_PTR_RET(cb, FALSE);
   CHECK_PTR_RET(name, FALSE);
@@ -192,24 +219,58 @@ int_t cb_call(cb_t * cb, uint8_t const * const name, ...)
   l = pair_second(bkt);
   CHECK_PTR_RET(l, FALSE);
   va_start(args, name);
-  itr = list_itr_begin(l);
-  end = list_itr_end(l);
-  for (; itr != end; itr = list_itr_next(l, itr))
-  {
-    p = (pair_t*)list_get(l, itr);
-    ctx = pair_first(p);
-    fn = pair_second(p);
-    if (!fn)
-      continue;
+  ret = call_list(cb, l, args);
+  va_end(args);
 
-#if DEBUG
-    cb->cb_calls++;
-#endif
+  return ret;
+}
 
-    /* call the callback */
-    (*fn)(ctx, args);
-    ret = TRUE;
+cb_id_t cb_id(uint8_t const * const name)
+{
+  cb_id_t id = CB_ID_INVALID;
+  CHECK_PTR_RET(name, CB_ID_INVALID);
+
+  pthread_mutex_lock(&cb_names_lock);
+  id = intern_name(name);
+  pthread_mutex_unlock(&cb_names_lock);
+
+  return id;
+}
+
+int_t cb_ids(uint8_t const * const * names, cb_id_t * ids, size_t n)
+{
+  size_t i;
+  int_t ret = TRUE;
+  CHECK_PTR_RET(names, FALSE);
+  CHECK_PTR_RET(ids, FALSE);
+
+  pthread_mutex_lock(&cb_names_lock);
+  for (i = 0; i < n; i++)
+  {
+    if (ids[i] == CB_ID_INVALID)
+      ids[i] = intern_name(names[i]);
+
+    if (ids[i] == CB_ID_INVALID)
+      ret = FALSE;
   }
+  pthread_mutex_unlock(&cb_names_lock);
+
+  return ret;
+}
+
+int_t cb_call_id(cb_t * cb, cb_id_t id, ...)
+{
+  va_list args;
+  int_t ret = FALSE;
+  list_t * l = NULL;
+
+  CHECK_PTR_RET(cb, FALSE);
+  CHECK_RET((id > CB_ID_INVALID) && (id < cb->nlists), FALSE);
+
+  l = cb->lists[id];
+  CHECK_PTR_RET(l, FALSE);
+  va_start(args, id);
+  ret = call_list(cb, l, args);
   va_end(args);
 
   return ret;
@@ -224,7 +285,7 @@ static int_t cb_init(cb_t *cb)
   UNIT_TEST_N_RET(cb_init);
 
   /* initialize the session */
-  cb->ht = ht_new(1, &cb_hash_fn, &cb_match_fn, &cb_delete_fn);
+  cb->ht = ht_new_flags(1, &cb_hash_fn, &cb_match_fn, &cb_delete_fn, HT_OPEN_ADDRESSED);
   CHECK_PTR_RET(cb->ht, FALSE);
 
   return TRUE;
@@ -233,28 +294,107 @@ static int_t cb_init(cb_t *cb)
 static void cb_deinit(cb_t *cb)
 {
   ht_delete(cb->ht);
+  FREE(cb->lists);
 }
 
+/* must be called with cb_names_lock held */
+static cb_id_t intern_name(uint8_t const * const name)
+{
+  pair_t * bkt = NULL;
+  uint8_t * s = NULL;
+
+  CHECK_PTR_RET(name, CB_ID_INVALID);
+
+  /* the registry lives for the life of the process */
+  if (cb_names == NULL)
+  {
+    cb_names = ht_new_flags(8, &cb_hash_fn, &cb_match_fn, &cb_delete_name_fn, HT_OPEN_ADDRESSED);
+    CHECK_PTR_RET(cb_names, CB_ID_INVALID);
+  }
+
+  bkt = find_bucket(cb_names, name);
+  if (bkt != NULL)
+    return (cb_id_t)(intptr_t)pair_second(bkt);
 
+  s = UT(STRDUP(C(name)));
+  CHECK_PTR_RET(s, CB_ID_INVALID);
+
+  bkt = pair_new(s, (void*)(intptr_t)cb_next_id);
+  CHECK_GOTO(bkt, _intern_name_fail1);
+
+  CHECK_GOTO(ht_insert(cb_names, bkt), _intern_name_fail2);
+
+  return cb_next_id++;
+
+_intern_name_fail2:
+  pair_delete(bkt);
+_intern_name_fail1:
+  FREE(s);
+  return CB_ID_INVALID;
+}
+
+static int_t grow_lists(cb_t * cb, cb_id_t id)
+{
+  list_t ** lists = NULL;
+  CHECK_PTR_RET(cb, FALSE);
+
+  if (id < cb->nlists)
+    return TRUE;
+
+  lists = (list_t**)REALLOC(cb->lists, (id + 1) * sizeof(list_t*));
+  CHECK_PTR_RET(lists, FALSE);
+
+  /* clear the new slots */
+  MEMSET(&lists[cb->nlists], 0, (id + 1 - cb->nlists) * sizeof(list_t*));
+
+  cb->lists = lists;
+  cb->nlists = id + 1;
+  return TRUE;
+}
+
+static int_t call_list(cb_t * cb, list_t * l, va_list args)
+{
+  va_list cargs;
+  int_t ret = FALSE;
+  pair_t * p = NULL;
+  list_itr_t itr, end;
+  void * ctx = NULL;
+  cbfn fn = NULL;
+
+  itr = list_itr_begin(l);
+  end = list_itr_end(l);
+  for (; itr != end; itr = list_itr_next(l, itr))
+  {
+    p = (pair_t*)list_get(l, itr);
+    ctx = pair_first(p);
+    fn = pair_second(p);
+    if (!fn)
+      continue;
+
+#if DEBUG
+    cb->cb_calls++;
+#endif
+
+    /* each callback gets its own copy of the args */
+    va_copy(cargs, args);
+    (*fn)(ctx, cargs);
+    va_end(cargs);
+    ret = TRUE;
+  }
+
+  return ret;
+}
 
 static pair_t* find_bucket(ht_t * ht, uint8_t const * const name)
 {
   ht_itr_t itr;
   pair_t * bkt = NULL;
-  pair_t * p = NULL;
 
   CHECK_PTR_RET(ht, NULL);
   CHECK_PTR_RET(name, NULL);
 
-  /* allocate a temporary pair */
-  p = pair_new((void*)name, NULL);
-  CHECK_PTR_RET(p, NULL);
-
   /* look up bucket by name */
-  itr = ht_find(ht, p);
-
-  /* delete temporary pair */
-  pair_delete(p);
+  itr = ht_find_key(ht, name, fnv_key_hash(name), &cb_name_match_fn);
 
   if (ITR_EQ(itr, ht_itr_end(ht)))
     return NULL;
@@ -348,6 +488,14 @@ static int_t cb_match_fn(void const * const l, void const * const r)
   return (strcmp(pair_first(l), pair_first(r)) == 0);
 }
 
+static int_t cb_name_match_fn(void const * const name, void const * const bkt)
+{
+  CHECK_PTR_RET(name, 0);
+  CHECK_PTR_RET(bkt, 0);
+
+  return (strcmp(name, pair_first(bkt)) == 0);
+}
+
 static void cb_delete_fn(void * p)
 {
   CHECK_PTR(p);
@@ -362,6 +510,17 @@ static void cb_delete_fn(void * p)
   pair_delete(p);
 }
 
+static void cb_delete_name_fn(void * p)
+{
+  CHECK_PTR(p);
+
+  /* free the interned name */
+  FREE(pair_first(p));
+
+  /* delete the name pair */
+  pair_delete(p);
+}
+
 #ifdef UNIT_TESTING
 
 #include <CUnit/Basic.h>
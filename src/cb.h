@@ -33,6 +33,10 @@ typedef void (*cbfn)(void * ctx, va_list args);
 
 typedef struct cb_s cb_t;
 
+/* interned callback name handle */
+typedef int_t cb_id_t;
+#define CB_ID_INVALID (0)
+
 /* alloc/dealloc cb structs */
 cb_t* cb_new(void);
 void cb_delete(void * p);
@@ -47,6 +51,21 @@ int_t cb_remove(cb_t * cb, uint8_t const * const name, void * ctx, cbfn fn);
 /* calls all callbacks associated with the name, passing given params */
 int_t cb_call(cb_t * cb, uint8_t const * const name, ...);
 
+/* interns a callback name and returns its process-wide id.  the ids are small
+ * integers starting at 1 so a zero-initialized id means "not resolved yet". */
+cb_id_t cb_id(uint8_t const * const name);
+
+/* resolves an array of names into the matching array of ids, skipping any
+ * that are already resolved.  meant to be called once, at init time. */
+int_t cb_ids(uint8_t const * const * names, cb_id_t * ids, size_t n);
+
+/* same as cb_add for a name whose id was already resolved with cb_id() or
+ * cb_ids(), so the process-wide name registry isn't touched */
+int_t cb_add_id(cb_t * cb, cb_id_t id, uint8_t const * const name, void * ctx, cbfn fn);
+
+/* same as cb_call but looks up the callbacks by id, no hashing involved */
+int_t cb_call_id(cb_t * cb, cb_id_t id, ...);
+
 /* helper macros make declaring callbacks easier.  you only need to provide
  * the name, the pointer to the function, the type of the context object, and
  * the types of the parameters, if any.  the name of the CB_* macro
@@ -81,6 +100,7 @@ int_t cb_call(cb_t * cb, uint8_t const * const name, ...);
  */
 
 #define ADD_CB(cb,n,fn,c) cb_add(cb,n,c,&cb___##fn)
+#define ADD_CB_ID(cb,id,n,fn,c) cb_add_id(cb,id,n,c,&cb___##fn)
 #define REMOVE_CB(cb,n,fn,c) cb_remove(cb,n,c,&cb___##fn)
 #define CB_0(fn,x) \
   static void cb___##fn(void * ctx, va_list args) { \
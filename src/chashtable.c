@@ -0,0 +1,402 @@
+/* Copyright (c) 2012-2015 David Huseby
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "debug.h"
+#include "macros.h"
+#include "hashtable.h"
+#include "chashtable.h"
+
+#if defined(UNIT_TESTING)
+#include "test_flags.h"
+#endif
+
+/* the most shards a table can have */
+#define CHT_MAX_SHARDS (1<<16)
+
+/* forward declarations of private functions */
+static uint_t cht_index(cht_t const * cht, uint_t hash);
+static cht_shard_t* cht_lock(cht_t * cht, uint_t hash, int_t write);
+
+cht_t* cht_new(uint_t nshards, uint_t initial_capacity, ht_hash_fn hfn,
+               ht_match_fn mfn, ht_delete_fn dfn, uint_t flags)
+{
+  cht_t* cht = NULL;
+
+  /* allocate a concurrent hashtable struct */
+  cht = (cht_t*)CALLOC(1, sizeof(cht_t));
+  CHECK_PTR_RET(cht, NULL);
+
+  /* initialize the concurrent hashtable */
+  if (!cht_init(cht, nshards, initial_capacity, hfn, mfn, dfn, flags))
+  {
+    FREE(cht);
+    return NULL;
+  }
+
+  return cht;
+}
+
+/* deinitializes and frees a concurrent hashtable allocated with cht_new() */
+void cht_delete(void * c)
+{
+  cht_t * cht = (cht_t*)c;
+  CHECK_PTR(cht);
+
+  cht_deinit(cht);
+
+  FREE((void*)cht);
+}
+
+int_t cht_init(cht_t * cht, uint_t nshards, uint_t initial_capacity,
+               ht_hash_fn hfn, ht_match_fn mfn, ht_delete_fn dfn,
+               uint_t flags)
+{
+  uint_t i, n = 1, bits = 0;
+
+  UNIT_TEST_RET(cht_init);
+
+  CHECK_PTR_RET(cht, FALSE);
+  CHECK_PTR_RET(hfn, FALSE);
+  CHECK_PTR_RET(mfn, FALSE);
+  CHECK_RET(nshards > 0, FALSE);
+  CHECK_RET(nshards <= CHT_MAX_SHARDS, FALSE);
+
+  MEMSET(cht, 0, sizeof(cht_t));
+
+  /* round the shard count up to a power of two */
+  while (n < nshards)
+  {
+    n <<= 1;
+    bits++;
+  }
+
+  cht->hfn = hfn;
+  cht->mfn = mfn;
+  cht->nshards = n;
+  /* the mixer in cht_index works on 64 bits whatever the size of uint_t */
+  cht->shift = 64 - bits;
+
+  /* over allocate by a shard so the array can start on a cache line */
+  cht->mem = CALLOC(n + 1, sizeof(cht_shard_t));
+  CHECK_PTR_RET(cht->mem, FALSE);
+  cht->shards = (cht_shard_t*)(((uintptr_t)cht->mem + (CHT_CACHE_LINE - 1)) &
+                               ~((uintptr_t)(CHT_CACHE_LINE - 1)));
+
+  for (i = 0; i < n; i++)
+  {
+    if (!ht_init_flags(&(cht->shards[i].ht), (initial_capacity / n) + 1,
+                       hfn, mfn, dfn, flags))
+      break;
+
+    if (pthread_rwlock_init(&(cht->shards[i].lock), NULL) != 0)
+    {
+      ht_deinit(&(cht->shards[i].ht));
+      break;
+    }
+  }
+
+  if (i < n)
+  {
+    /* undo the shards that were set up */
+    cht->nshards = i;
+    cht_deinit(cht);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* deinitialize a concurrent hashtable, nothing may be using it */
+int_t cht_deinit(cht_t * cht)
+{
+  uint_t i;
+
+  UNIT_TEST_RET(cht_deinit);
+
+  CHECK_PTR_RET(cht, FALSE);
+
+  for (i = 0; (cht->shards != NULL) && (i < cht->nshards); i++)
+  {
+    ht_deinit(&(cht->shards[i].ht));
+    pthread_rwlock_destroy(&(cht->shards[i].lock));
+  }
+
+  FREE(cht->mem);
+  cht->mem = NULL;
+  cht->shards = NULL;
+  cht->nshards = 0;
+
+  return TRUE;
+}
+
+uint_t cht_count(cht_t * cht)
+{
+  uint_t i, count = 0;
+
+  CHECK_PTR_RET(cht, 0);
+
+  for (i = 0; i < cht->nshards; i++)
+  {
+    pthread_rwlock_rdlock(&(cht->shards[i].lock));
+    count += cht->shards[i].ht.count;
+    pthread_rwlock_unlock(&(cht->shards[i].lock));
+  }
+
+  return count;
+}
+
+int_t cht_insert(cht_t * cht, void * data)
+{
+  int_t ret;
+  cht_shard_t * shard;
+
+  CHECK_PTR_RET(cht, FALSE);
+  CHECK_PTR_RET(data, FALSE);
+
+  shard = cht_lock(cht, (*(cht->hfn))(data), TRUE);
+  CHECK_PTR_RET(shard, FALSE);
+  ret = ht_insert(&(shard->ht), data);
+  pthread_rwlock_unlock(&(shard->lock));
+
+  return ret;
+}
+
+void* cht_insert_or_get(cht_t * cht, void * data, int_t * inserted)
+{
+  void * item;
+  cht_shard_t * shard;
+
+  CHECK_PTR_RET(cht, NULL);
+  CHECK_PTR_RET(data, NULL);
+  CHECK_PTR_RET(inserted, NULL);
+
+  shard = cht_lock(cht, (*(cht->hfn))(data), TRUE);
+  CHECK_PTR_RET(shard, NULL);
+  item = ht_get(&(shard->ht), ht_insert_or_get(&(shard->ht), data, inserted));
+  pthread_rwlock_unlock(&(shard->lock));
+
+  return item;
+}
+
+void* cht_find(cht_t * cht, void * data)
+{
+  CHECK_PTR_RET(cht, NULL);
+  CHECK_PTR_RET(data, NULL);
+
+  /* the match function works as a key match function with data as the key */
+  return cht_find_key(cht, data, (*(cht->hfn))(data), cht->mfn);
+}
+
+void* cht_find_key(cht_t * cht, void const * key, uint_t hash,
+                   ht_key_match_fn kmfn)
+{
+  void * item;
+  cht_shard_t * shard;
+
+  CHECK_PTR_RET(cht, NULL);
+  CHECK_PTR_RET(kmfn, NULL);
+
+  shard = cht_lock(cht, hash, FALSE);
+  CHECK_PTR_RET(shard, NULL);
+  item = ht_get(&(shard->ht), ht_find_key(&(shard->ht), key, hash, kmfn));
+  pthread_rwlock_unlock(&(shard->lock));
+
+  return item;
+}
+
+void* cht_remove(cht_t * cht, void * data)
+{
+  void * item;
+  uint_t hash;
+  ht_itr_t itr;
+  cht_shard_t * shard;
+
+  CHECK_PTR_RET(cht, NULL);
+  CHECK_PTR_RET(data, NULL);
+
+  hash = (*(cht->hfn))(data);
+  shard = cht_lock(cht, hash, TRUE);
+  CHECK_PTR_RET(shard, NULL);
+  itr = ht_find_key(&(shard->ht), data, hash, cht->mfn);
+  item = ht_get(&(shard->ht), itr);
+  if (item != NULL)
+    ht_remove(&(shard->ht), itr);
+  pthread_rwlock_unlock(&(shard->lock));
+
+  return item;
+}
+
+int_t cht_clear(cht_t * cht)
+{
+  uint_t i;
+  int_t ret = TRUE;
+
+  CHECK_PTR_RET(cht, FALSE);
+
+  for (i = 0; i < cht->nshards; i++)
+  {
+    pthread_rwlock_wrlock(&(cht->shards[i].lock));
+    if (!ht_clear(&(cht->shards[i].ht)))
+      ret = FALSE;
+    pthread_rwlock_unlock(&(cht->shards[i].lock));
+  }
+
+  return ret;
+}
+
+int_t cht_foreach(cht_t * cht, cht_visit_fn fn, void * user)
+{
+  uint_t i;
+  int_t ret = TRUE;
+  ht_t * ht;
+  ht_itr_t itr;
+
+  CHECK_PTR_RET(cht, FALSE);
+  CHECK_PTR_RET(fn, FALSE);
+
+  for (i = 0; ret && (i < cht->nshards); i++)
+  {
+    ht = cht_shard_lock(cht, i, FALSE);
+    CHECK_PTR_RET(ht, FALSE);
+
+    for (itr = ht_itr_begin(ht); ret && !ITR_EQ(itr, ht_itr_end(ht)); itr = ht_itr_next(ht, itr))
+    {
+      ret = (*fn)(ht_get(ht, itr), user);
+    }
+
+    cht_shard_unlock(cht, i);
+  }
+
+  return ret;
+}
+
+ht_t* cht_shard_lock(cht_t * cht, uint_t i, int_t write)
+{
+  int err;
+
+  CHECK_PTR_RET(cht, NULL);
+  CHECK_RET(i < cht->nshards, NULL);
+
+  if (write)
+    err = pthread_rwlock_wrlock(&(cht->shards[i].lock));
+  else
+    err = pthread_rwlock_rdlock(&(cht->shards[i].lock));
+  CHECK_RET(err == 0, NULL);
+
+  return &(cht->shards[i].ht);
+}
+
+void cht_shard_unlock(cht_t * cht, uint_t i)
+{
+  CHECK_PTR(cht);
+  CHECK(i < cht->nshards);
+
+  pthread_rwlock_unlock(&(cht->shards[i].lock));
+}
+
+uint_t cht_shard_count(cht_t * cht)
+{
+  CHECK_PTR_RET(cht, 0);
+  return cht->nshards;
+}
+
+/*
+ * PRIVATE
+ */
+
+/* picks the shard from the top bits of a different mix than the one the
+ * shards' own tables use, otherwise every item in a shard would land in the
+ * same few buckets of it. */
+static uint_t cht_index(cht_t const * cht, uint_t hash)
+{
+  uint64_t x = (uint64_t)hash;
+
+  if (cht->nshards == 1)
+    return 0;
+
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  x = x ^ (x >> 31);
+  return (uint_t)(x >> cht->shift);
+}
+
+/* locks and returns the shard hash belongs in */
+static cht_shard_t* cht_lock(cht_t * cht, uint_t hash, int_t write)
+{
+  uint_t i = cht_index(cht, hash);
+  return (cht_shard_lock(cht, i, write) != NULL) ? &(cht->shards[i]) : NULL;
+}
+
+#if defined(UNIT_TESTING)
+
+#include <CUnit/Basic.h>
+
+static uint_t test_hash_fn(void const * key)
+{
+  return (uint_t)(uintptr_t)key;
+}
+
+static int_t test_match_fn(void const * l, void const * r)
+{
+  return (l == r);
+}
+
+void test_chashtable_private_functions(void)
+{
+  cht_t cht;
+  uint_t i, n;
+  uint_t hits[64];
+
+  MEMSET(&cht, 0, sizeof(cht_t));
+  cht.nshards = 1;
+  CU_ASSERT_EQUAL(cht_index(&cht, 12345), 0);
+
+  /* with the shift cht_init computes, every shard index must be in range
+   * and reachable */
+  for (n = 2; n <= 64; n <<= 1)
+  {
+    CU_ASSERT_TRUE(cht_init(&cht, n, 1, &test_hash_fn, &test_match_fn, NULL, 0));
+    MEMSET(hits, 0, sizeof(hits));
+    for (i = 0; i < 4096; i++)
+    {
+      CU_ASSERT_TRUE(cht_index(&cht, i) < cht.nshards);
+      if (cht_index(&cht, i) < cht.nshards)
+        hits[cht_index(&cht, i)]++;
+    }
+    for (i = 0; i < cht.nshards; i++)
+    {
+      CU_ASSERT_TRUE(hits[i] > 0);
+    }
+    CU_ASSERT_TRUE(cht_deinit(&cht));
+  }
+}
+
+#endif
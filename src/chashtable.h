@@ -0,0 +1,124 @@
+/* Copyright (c) 2012-2015 David Huseby
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CHASHTABLE_H
+#define CHASHTABLE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "macros.h"
+#include "hashtable.h"
+
+/* a hashtable that is safe to share between threads.  the items are spread
+ * over a power of two number of shards by their hash and each shard is a
+ * plain ht_t with its own reader/writer lock, so threads touching different
+ * shards never contend and readers of the same shard run in parallel.
+ *
+ * there are no iterators because they can't outlive the shard lock.  lookups
+ * return the item itself and iteration is done one locked shard at a time
+ * with cht_foreach() or cht_shard_lock()/cht_shard_unlock(). */
+
+#define CHT_CACHE_LINE (64)
+
+/* a shard, padded out to whole cache lines so that neighbouring locks don't
+ * share a line */
+typedef struct cht_shard_s
+{
+  pthread_rwlock_t    lock;         /* guards ht */
+  ht_t                ht;           /* the shard's items */
+  uint8_t             pad[CHT_CACHE_LINE -
+                          ((sizeof(pthread_rwlock_t) + sizeof(ht_t)) % CHT_CACHE_LINE)];
+} cht_shard_t;
+
+/* visit function prototype for cht_foreach().  it must return TRUE to keep
+ * going or FALSE to stop. */
+typedef int_t (*cht_visit_fn)(void * data, void * user);
+
+/* the concurrent hash table structure */
+typedef struct cht_s
+{
+  ht_hash_fn          hfn;          /* hash function */
+  ht_match_fn         mfn;          /* match function */
+  uint_t              nshards;      /* number of shards, a power of two */
+  uint_t              shift;        /* hash shift that picks the shard */
+  void*               mem;          /* the allocation holding shards */
+  cht_shard_t*        shards;       /* cache line aligned shard array */
+} cht_t;
+
+/* heap allocated concurrent hash table.  nshards is rounded up to a power of
+ * two and each shard starts with room for initial_capacity / nshards items.
+ * flags are the ht_t layout flags used for every shard. */
+cht_t* cht_new(uint_t nshards, uint_t initial_capacity, ht_hash_fn hfn,
+               ht_match_fn mfn, ht_delete_fn dfn, uint_t flags);
+void cht_delete(void * cht);
+
+/* stack allocated concurrent hash table */
+int_t cht_init(cht_t * cht, uint_t nshards, uint_t initial_capacity,
+               ht_hash_fn hfn, ht_match_fn mfn, ht_delete_fn dfn,
+               uint_t flags);
+int_t cht_deinit(cht_t * cht);
+
+/* returns the number of items stored.  the shards are counted one at a time
+ * so the total is only exact if nothing is inserting or removing. */
+uint_t cht_count(cht_t * cht);
+
+/* inserts the given data.  as with ht_insert(), it fails if a matching item
+ * is already stored. */
+int_t cht_insert(cht_t * cht, void * data);
+
+/* returns the item matching data, inserting data first if there isn't one.
+ * *inserted is set to TRUE if data was inserted.  returns NULL on failure. */
+void* cht_insert_or_get(cht_t * cht, void * data, int_t * inserted);
+
+/* finds the item matching data, returns NULL if there isn't one */
+void* cht_find(cht_t * cht, void * data);
+
+/* finds the item matching key, see ht_find_key() */
+void* cht_find_key(cht_t * cht, void const * key, uint_t hash,
+                   ht_key_match_fn kmfn);
+
+/* removes and returns the item matching data, it isn't deleted */
+void* cht_remove(cht_t * cht, void * data);
+
+/* clears all data from every shard */
+int_t cht_clear(cht_t * cht);
+
+/* calls fn on every item.  each shard is read locked while its items are
+ * visited so every shard is seen in a consistent state, but the shards are
+ * not locked together.  fn must not modify the table.  returns FALSE if fn
+ * stopped the walk early. */
+int_t cht_foreach(cht_t * cht, cht_visit_fn fn, void * user);
+
+/* locks shard i and returns its hashtable for direct iteration.  with write
+ * set to FALSE the table must only be read.  every successful lock must be
+ * paired with cht_shard_unlock(). */
+ht_t* cht_shard_lock(cht_t * cht, uint_t i, int_t write);
+void cht_shard_unlock(cht_t * cht, uint_t i);
+
+/* returns the number of shards */
+uint_t cht_shard_count(cht_t * cht);
+
+#endif /*CHASHTABLE_H*/
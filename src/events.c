@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "debug.h"
 #include "macros.h"
@@ -81,10 +82,13 @@ struct evt_s
   child_params_t  child_params;
   io_params_t     io_params;
   cb_t            *cb;        /* callbacks handler */
+  evt_io_fn       io_fn;      /* direct io handler, used instead of cb */
+  void            *io_ctx;    /* context passed to io_fn */
 
   evt_loop_t *    el;         /* the event loop associated with */
 };
 
+static void evt_resolve_cb_ids(void);
 static int_t evt_init_event(evt_t * evt, cb_t *cb, evt_type_t t, va_list args);
 static void evt_deinit_event(evt_t * evt);
 static void evt_signal_cb(struct ev_loop * loop, struct ev_signal * w, int revents);
@@ -92,6 +96,8 @@ static void evt_child_cb(struct ev_loop * loop, struct ev_child * w, int revents
 static void evt_io_cb(struct ev_loop * loop, struct ev_io * w, int revents);
 static void evt_cb(evt_t * evt);
 static void evt_log_backend(evt_loop_t * el);
+static void evt_thread_break_cb(struct ev_loop * l, struct ev_async * w, int r);
+static void * evt_thread_main(void * arg);
 #ifdef DEBUG_ON
 static size_t get_signals_debug_string(sigset_t const * sigs, uint8_t ** p);
 #endif
@@ -103,8 +109,13 @@ uint8_t const * const evt_type_cb[EVT_TYPE_COUNT] =
   UT("evt-io")
 };
 
+/* callback ids, resolved from evt_type_cb once per process */
+static cb_id_t evt_type_cb_ids[EVT_TYPE_COUNT];
+static int_t evt_type_cb_ok = FALSE;
+static pthread_once_t evt_type_cb_once = PTHREAD_ONCE_INIT;
+
 /* helper macro for calling callbacks */
-#define EVT(cb, ...) cb_call(cb, EVT_CB_NAME(evt->type), __VA_ARGS__)
+#define EVT(cb, ...) cb_call_id(cb, evt_type_cb_ids[evt->type], __VA_ARGS__)
 
 /*
  * EVENT LOOP
@@ -130,8 +141,8 @@ void evt_delete(void * e)
 
   CHECK_PTR(el);
 
-  /* clean up the default event loop */
-  ev_loop_destroy(EV_DEFAULT_UC);
+  /* clean up the event loop */
+  ev_loop_destroy((struct ev_loop*)el);
 }
 
 evt_ret_t evt_run(evt_loop_t * el)
@@ -157,6 +168,88 @@ evt_ret_t evt_stop(evt_loop_t * el, int_t once)
   return EVT_OK;
 }
 
+/*
+ * THREADED EVENT LOOPS
+ */
+
+struct evt_thread_s
+{
+  struct ev_loop *  loop;     /* the thread's own event loop */
+  struct ev_async   wake;     /* breaks the loop from another thread */
+  pthread_t         thread;   /* the thread running the loop */
+  int_t             running;  /* has the thread been started? */
+};
+
+evt_thread_t * evt_thread_new(void)
+{
+  evt_thread_t * t = NULL;
+  struct ev_async * wake = NULL;
+
+  t = (evt_thread_t*)CALLOC(1, sizeof(evt_thread_t));
+  CHECK_PTR_RET(t, NULL);
+
+  /* create a loop of our own, the default loop belongs to the main thread */
+  t->loop = ev_loop_new(EVFLAG_AUTO | EVFLAG_NOENV);
+  CHECK_PTR_GOTO(t->loop, _evt_thread_new_1);
+
+  /* the async watcher also keeps the loop running while there is no io */
+  wake = &(t->wake);
+  ev_async_init(wake, &evt_thread_break_cb);
+  ev_async_start(t->loop, wake);
+
+  evt_log_backend((evt_loop_t*)t->loop);
+
+  return t;
+
+_evt_thread_new_1:
+  FREE(t);
+  return NULL;
+}
+
+void evt_thread_delete(void * p)
+{
+  evt_thread_t * t = (evt_thread_t*)p;
+  CHECK_PTR(t);
+
+  evt_thread_stop(t);
+  ev_async_stop(t->loop, &(t->wake));
+  ev_loop_destroy(t->loop);
+  FREE(t);
+}
+
+evt_loop_t * evt_thread_loop(evt_thread_t * t)
+{
+  CHECK_PTR_RET(t, NULL);
+  return (evt_loop_t*)t->loop;
+}
+
+evt_ret_t evt_thread_start(evt_thread_t * t)
+{
+  CHECK_PTR_RET(t, EVT_BADPTR);
+  CHECK_RET(!t->running, EVT_ERROR);
+
+  CHECK_RET(pthread_create(&(t->thread), NULL, &evt_thread_main, t) == 0, EVT_ERROR);
+  t->running = TRUE;
+
+  return EVT_OK;
+}
+
+evt_ret_t evt_thread_stop(evt_thread_t * t)
+{
+  CHECK_PTR_RET(t, EVT_BADPTR);
+  CHECK_RET(t->running, EVT_OK);
+
+  /* the loop's own thread can't join itself */
+  CHECK_RET(!pthread_equal(pthread_self(), t->thread), EVT_ERROR);
+
+  /* ev_break isn't thread safe, so wake the loop and break from inside it */
+  ev_async_send(t->loop, &(t->wake));
+  CHECK_RET(pthread_join(t->thread, NULL) == 0, EVT_ERROR);
+  t->running = FALSE;
+
+  return EVT_OK;
+}
+
 /*
  * EVENTS
  */
@@ -184,6 +277,21 @@ evt_t * evt_new_event(cb_t * cb, evt_type_t t, ...)
   return NULL;
 }
 
+evt_t * evt_new_io_event_fn(evt_io_fn fn, void * ctx, int fd, evt_io_type_t flags)
+{
+  evt_t * evt = NULL;
+
+  CHECK_PTR_RET(fn, NULL);
+
+  evt = evt_new_event(NULL, EVT_IO, fd, flags);
+  CHECK_PTR_RET(evt, NULL);
+
+  /* store the direct handler */
+  evt->io_fn = fn;
+  evt->io_ctx = ctx;
+
+  return evt;
+}
 
 void evt_delete_event(void * e)
 {
@@ -269,6 +377,30 @@ evt_ret_t evt_stop_event(evt_t * evt)
   return EVT_OK;
 }
 
+cb_id_t evt_cb_id(evt_type_t t)
+{
+  CHECK_RET(VALID_EVENT_TYPE(t), CB_ID_INVALID);
+  pthread_once(&evt_type_cb_once, &evt_resolve_cb_ids);
+  CHECK_RET(evt_type_cb_ok, CB_ID_INVALID);
+  return evt_type_cb_ids[t];
+}
+
+evt_ret_t evt_feed_event(evt_t * evt, evt_loop_t * el)
+{
+  CHECK_PTR_RET_MSG(el, EVT_BADPTR, "bad event loop pointer\n");
+  CHECK_PTR_RET_MSG(evt, EVT_BADPTR, "bad event pointer\n");
+  CHECK_RET(evt->type == EVT_IO, EVT_BADPARAM);
+  CHECK_RET((evt->el == NULL) || (evt->el == el), EVT_BADPARAM);
+
+  /* remember the loop so that stopping the event clears the pending call */
+  evt->el = el;
+
+  DEBUG("feeding io event\n");
+  ev_feed_event((struct ev_loop*)el, (void*)evt, evt->io_params.types);
+
+  return EVT_OK;
+}
+
 #ifdef DEBUG_ON
 void debug_signals_dump(uint8_t const * const prefix)
 {
@@ -298,12 +430,21 @@ void debug_signals_dump(uint8_t const * const prefix) {;}
  * PRIVATE FUNCTIONS
  */
 
+static void evt_resolve_cb_ids(void)
+{
+  evt_type_cb_ok = cb_ids(evt_type_cb, evt_type_cb_ids, EVT_TYPE_COUNT);
+}
+
 static int_t evt_init_event(evt_t * evt, cb_t *cb, evt_type_t t, va_list args)
 {
   UNIT_TEST_N_RET(event_init);
 
   CHECK_PTR_RET(evt, FALSE);
 
+  /* resolve the callback names to ids */
+  pthread_once(&evt_type_cb_once, &evt_resolve_cb_ids);
+  CHECK_RET(evt_type_cb_ok, FALSE);
+
   /* store the callbacks and type */
   evt->cb = cb;
   evt->type = t;
@@ -462,24 +603,39 @@ static void evt_cb(evt_t * evt)
   {
     case EVT_SIGNAL:
       DEBUG("calling signal callback\n");
-      sig = (struct ev_signal*)&evt;
+      sig = (struct ev_signal*)evt;
       EVT(evt->cb, evt, sig->signum);
       break;
 
     case EVT_CHILD:
       DEBUG("calling child callback\n");
-      child = (struct ev_child*)&evt;
+      child = (struct ev_child*)evt;
       EVT(evt->cb, evt, child->pid, child->rpid, child->rstatus);
       break;
 
     case EVT_IO:
       DEBUG("calling io callback\n");
-      io = (struct ev_io*)&evt;
-      EVT(evt->cb, evt, io->fd, (evt_io_type_t)io->events);
+      io = (struct ev_io*)evt;
+      if (evt->io_fn != NULL)
+        (*(evt->io_fn))(evt->io_ctx, evt, io->fd, (evt_io_type_t)io->events);
+      else
+        EVT(evt->cb, evt, io->fd, (evt_io_type_t)io->events);
       break;
   }
 }
 
+static void evt_thread_break_cb(struct ev_loop * l, struct ev_async * w, int r)
+{
+  ev_break(l, EVBREAK_ALL);
+}
+
+static void * evt_thread_main(void * arg)
+{
+  evt_thread_t * t = (evt_thread_t*)arg;
+  ev_run(t->loop, 0);
+  return NULL;
+}
+
 static void evt_log_backend(evt_loop_t * el)
 {
   unsigned int flags = 0;
@@ -631,6 +787,8 @@ static void test_evt_log_backend(void)
 
 void test_events_private_functions(void)
 {
+  CU_ASSERT_NOT_EQUAL(evt_cb_id(EVT_IO), CB_ID_INVALID);
+  CU_ASSERT_EQUAL(evt_cb_id(EVT_TYPE_COUNT), CB_ID_INVALID);
   test_evt_signal_cb();
   test_evt_child_cb();
   test_evt_io_cb();
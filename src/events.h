@@ -54,6 +54,9 @@ typedef enum evt_type_e
 extern uint8_t const * const evt_type_cb[EVT_TYPE_COUNT];
 #define EVT_CB_NAME(x) (VALID_EVENT_TYPE(x) ? evt_type_cb[x] : NULL)
 
+/* get the callback id for an event type, resolved once per process */
+cb_id_t evt_cb_id(evt_type_t t);
+
 typedef enum evt_io_type_e
 {
   EVT_IO_READ =  EV_READ,
@@ -79,6 +82,24 @@ evt_ret_t evt_run(evt_loop_t * el);
 /* stops the event loop */
 evt_ret_t evt_stop(evt_loop_t * el, int_t once);
 
+/*
+ * THREADED EVENT LOOPS
+ *
+ * An evt_thread_t owns a separate (non-default) event loop that runs on its
+ * own thread.  Set up the events on evt_thread_loop() before calling
+ * evt_thread_start().  evt_thread_stop() breaks the loop and joins the
+ * thread, it may be called from any thread except the loop's own (e.g. from
+ * one of its callbacks), where it fails with EVT_ERROR and the loop keeps
+ * running.  Signal and child events only work on the default loop.
+ */
+typedef struct evt_thread_s evt_thread_t;
+
+evt_thread_t * evt_thread_new(void);
+void evt_thread_delete(void * t);
+evt_loop_t * evt_thread_loop(evt_thread_t * t);
+evt_ret_t evt_thread_start(evt_thread_t * t);
+evt_ret_t evt_thread_stop(evt_thread_t * t);
+
 /*
  * EVENTS INTERFACE
  *
@@ -143,9 +164,9 @@ evt_ret_t evt_stop(evt_loop_t * el, int_t once);
 #define CHILD_CB(fn,ctx) CB_4(fn,ctx,evt_t*,int,int,int)
 #define IO_CB(fn,ctx) CB_3(fn,ctx,evt_t*,int,evt_io_type_t)
 
-#define ADD_SIGNAL_CB(cb,fn,ctx) ADD_CB(cb,EVT_CB_NAME(EVT_SIGNAL),fn,ctx)
-#define ADD_CHILD_CB(cb,fn,ctx) ADD_CB(cb,EVT_CB_NAME(EVT_CHILD),fn,ctx)
-#define ADD_IO_CB(cb,fn,ctx) ADD_CB(cb,EVT_CB_NAME(EVT_IO),fn,ctx)
+#define ADD_SIGNAL_CB(cb,fn,ctx) ADD_CB_ID(cb,evt_cb_id(EVT_SIGNAL),EVT_CB_NAME(EVT_SIGNAL),fn,ctx)
+#define ADD_CHILD_CB(cb,fn,ctx) ADD_CB_ID(cb,evt_cb_id(EVT_CHILD),EVT_CB_NAME(EVT_CHILD),fn,ctx)
+#define ADD_IO_CB(cb,fn,ctx) ADD_CB_ID(cb,evt_cb_id(EVT_IO),EVT_CB_NAME(EVT_IO),fn,ctx)
 
 /* create a new event */
 #define evt_new_signal_event(cb, signum) evt_new_event(cb,EVT_SIGNAL,signum)
@@ -153,6 +174,12 @@ evt_ret_t evt_stop(evt_loop_t * el, int_t once);
 #define evt_new_io_event(cb, fd, flags) evt_new_event(cb,EVT_IO,fd,flags)
 evt_t * evt_new_event(cb_t * cb, evt_type_t t, ...);
 
+/* create a new io event that calls fn directly instead of going through a
+ * cb_t.  this is for internal users like aiofd that have exactly one handler
+ * and don't want a callback manager per event. */
+typedef void (*evt_io_fn)(void * ctx, evt_t * evt, int fd, evt_io_type_t types);
+evt_t * evt_new_io_event_fn(evt_io_fn fn, void * ctx, int fd, evt_io_type_t flags);
+
 /* delete function for events */
 void evt_delete_event(void * e);
 
@@ -162,6 +189,11 @@ evt_ret_t evt_start_event(evt_t * evt, evt_loop_t * el);
 /* stop the event */
 evt_ret_t evt_stop_event(evt_t * evt);
 
+/* queue an io event's callback to run on the next iteration of the loop as
+ * if the fd were ready, without starting the event.  stopping or deleting the
+ * event before then cancels it. */
+evt_ret_t evt_feed_event(evt_t * evt, evt_loop_t * el);
+
 /*
  * DEBUG
  */
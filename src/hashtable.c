@@ -28,6 +28,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "debug.h"
 #include "macros.h"
@@ -39,8 +42,35 @@
 ht_itr_t fake_ht_find_ret;
 #endif
 
-#define LIST_AT(lists, index)  (&(lists[index]))
-#define ITEM_AT(lists, itr) (list_get(LIST_AT(itr.list), itr.itr))
+/* the smallest node array for the chained layout */
+#define HT_NODE_MIN (16)
+
+/* number of 64 bit words in a bitmap of n nodes */
+#define HT_WORDS(n) (((n) + 63) / 64)
+
+/* number of lookups ht_find_many has in flight */
+#define HT_BATCH (16)
+
+/* hint that p will be read soon */
+#if defined(__GNUC__)
+#define HT_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#else
+#define HT_PREFETCH(p) {;}
+#endif
+
+/* number of old buckets moved per insert during an incremental resize */
+#define HT_MIGRATE_STEP (4)
+
+/* open addressing control bytes.  a full slot stores the low 7 bits of the
+ * hash so most mismatches are rejected without calling the match function. */
+#define HT_GROUP (16)
+#define HT_EMPTY ((uint8_t)0x80)
+#define HT_DELETED ((uint8_t)0xFE)
+#define HT_IS_FULL(c) (((c) & 0x80) == 0)
+#define HT_H1(h) ((h) >> 7)
+#define HT_H2(h) ((uint8_t)((h) & 0x7F))
+#define HT_MAX_LOAD(size) ((size) - ((size) / 8))
+#define IS_OPEN(h) ((h)->flags & HT_OPEN_ADDRESSED)
 
 /* index constants */
 ht_itr_t const ht_itr_end_t = { -1, -1 };
@@ -58,19 +88,138 @@ uint_t const PRIMES[] =
   6151, 12289, 24593, 49157,
   98317, 196613, 393241, 786433,
   1572869, 3145739, 6291469,
-  12582917, 251658343, 50331653,
+  12582917, 25165843, 50331653,
   100663319, 201326611,
   402563189, 805306457,
   1610612741
 };
 
+/* spread the caller's hash over all of the bits, the open addressed layout
+ * uses the low bits for the control byte and the high bits for the group */
+static inline uint_t ht_mix(uint_t h)
+{
+  uint64_t x = (uint64_t)h * 0x9E3779B97F4A7C15ULL;
+  return (uint_t)(x ^ (x >> 32));
+}
+
+/* log2 of a power of two */
+static inline uint_t ht_log2(uint_t size)
+{
+#if defined(__GNUC__)
+  return (uint_t)__builtin_ctzll((unsigned long long)size);
+#else
+  uint_t n = 0;
+  while (size > 1)
+  {
+    size >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* picks the chained bucket for hash in a bucket array of the given size.
+ * power of two tables use the top bits of hash * 2^64/phi. */
+static inline uint_t ht_bucket(ht_t const * htable, uint_t hash, uint_t size)
+{
+  if (htable->flags & HT_POW2)
+    return (uint_t)(((uint64_t)hash * 0x9E3779B97F4A7C15ULL) >> (64 - ht_log2(size)));
+  return hash % size;
+}
+
+/* index of the lowest set bit, bits is never 0 */
+static inline uint_t ht_ctz(uint64_t bits)
+{
+#if defined(__GNUC__)
+  return (uint_t)__builtin_ctzll((unsigned long long)bits);
+#else
+  uint_t n = 0;
+  while (!(bits & 1))
+  {
+    bits >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* index of the highest set bit, bits is never 0 */
+static inline uint_t ht_msb(uint64_t bits)
+{
+#if defined(__GNUC__)
+  return (uint_t)(63 - __builtin_clzll((unsigned long long)bits));
+#else
+  uint_t n = 0;
+  while (bits >>= 1)
+    n++;
+  return n;
+#endif
+}
+
+/* returns a bitmask of the bytes in the group equal to b */
+static inline uint32_t ht_group_match(uint8_t const * ctrl, uint8_t b)
+{
+#if defined(__SSE2__)
+  __m128i g = _mm_loadu_si128((__m128i const *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)b)));
+#else
+  uint_t i;
+  uint32_t bits = 0;
+  for (i = 0; i < HT_GROUP; i++)
+  {
+    if (ctrl[i] == b)
+      bits |= (1U << i);
+  }
+  return bits;
+#endif
+}
+
+/* returns a bitmask of the empty or deleted bytes in the group */
+static inline uint32_t ht_group_free(uint8_t const * ctrl)
+{
+#if defined(__SSE2__)
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((__m128i const *)ctrl));
+#else
+  uint_t i;
+  uint32_t bits = 0;
+  for (i = 0; i < HT_GROUP; i++)
+  {
+    if (!HT_IS_FULL(ctrl[i]))
+      bits |= (1U << i);
+  }
+  return bits;
+#endif
+}
+
 /* forward declarations of private functions */
 static uint_t ht_get_new_size(uint_t count, float limit);
+static uint_t ht_get_pow2_size(uint_t count, float limit);
 static int_t ht_grow(ht_t * htable);
+static void ht_migrate(ht_t * htable, uint_t n);
+static ht_itr_t ht_find_hash(ht_t const * htable, void const * key, uint_t hash,
+                             ht_key_match_fn match);
+static int_t ht_find_chain(ht_t const * htable, int_t n, void const * key,
+                           uint_t hash, ht_key_match_fn match);
+static int_t ht_unlink(ht_t * htable, int_t * head, int_t n);
+static ht_itr_t ht_node_scan(ht_t const * htable, int_t i, int_t dir);
+static int_t ht_get_node(ht_t * htable);
+static void ht_put_node(ht_t * htable, int_t n);
+static ht_entry_t * ht_entry_at(ht_t const * htable, ht_itr_t itr);
+static int_t ht_oa_grow(ht_t * htable);
+static int_t ht_oa_find(ht_t const * htable, void const * key, uint_t hash,
+                        ht_key_match_fn match);
+static uint_t ht_oa_free_slot(ht_t const * htable, uint_t hash);
+static ht_itr_t ht_oa_scan(ht_t const * htable, int_t i, int_t dir);
 
 /* heap allocate the hashtable */
 ht_t* ht_new(uint_t initial_capacity, ht_hash_fn hfn,
               ht_match_fn mfn, ht_delete_fn dfn)
+{
+  return ht_new_flags(initial_capacity, hfn, mfn, dfn, HT_CHAINED);
+}
+
+ht_t* ht_new_flags(uint_t initial_capacity, ht_hash_fn hfn,
+                   ht_match_fn mfn, ht_delete_fn dfn, uint_t flags)
 {
   ht_t* htable = NULL;
 
@@ -79,7 +228,7 @@ ht_t* ht_new(uint_t initial_capacity, ht_hash_fn hfn,
   CHECK_PTR_RET(htable, NULL);
 
   /* initialize the hashtable */
-  if (!ht_init(htable, initial_capacity, hfn, mfn, dfn))
+  if (!ht_init_flags(htable, initial_capacity, hfn, mfn, dfn, flags))
   {
     FREE(htable);
     return NULL;
@@ -105,6 +254,13 @@ void ht_delete(void * ht)
 /* initializes a hashtable */
 int_t ht_init(ht_t * htable, uint_t initial_capacity,
                    ht_hash_fn hfn, ht_match_fn mfn, ht_delete_fn dfn)
+{
+  return ht_init_flags(htable, initial_capacity, hfn, mfn, dfn, HT_CHAINED);
+}
+
+int_t ht_init_flags(ht_t * htable, uint_t initial_capacity,
+                    ht_hash_fn hfn, ht_match_fn mfn, ht_delete_fn dfn,
+                    uint_t flags)
 {
   UNIT_TEST_RET(ht_init);
 
@@ -121,6 +277,8 @@ int_t ht_init(ht_t * htable, uint_t initial_capacity,
   htable->dfn = dfn;
   htable->initial = initial_capacity;
   htable->limit = default_load_limit;
+  htable->flags = flags;
+  htable->free = -1;
 
   CHECK_RET(ht_grow(htable), FALSE);
 
@@ -136,14 +294,40 @@ int_t ht_deinit(ht_t * htable)
 
   CHECK_PTR_RET(htable, FALSE);
 
-  /* free up all of the memory in the lists */
-  for(i = 0; i < htable->size; i++)
+  if (IS_OPEN(htable))
+  {
+    /* delete the items in the full slots */
+    for (i = 0; (htable->dfn != NULL) && (i < htable->size); i++)
+    {
+      if (HT_IS_FULL(htable->ctrl[i]))
+        (*(htable->dfn))(htable->slots[i].data);
+    }
+
+    FREE(htable->ctrl);
+    FREE(htable->slots);
+    return TRUE;
+  }
+
+  /* delete the items in the used nodes */
+  for (i = 0; (htable->dfn != NULL) && (i < htable->nnext); i++)
   {
-    list_deinit(LIST_AT(htable->lists, i));
+    if (htable->nodes[i].entry.data != NULL)
+      (*(htable->dfn))(htable->nodes[i].entry.data);
   }
 
-  /* free up the lists */
-  FREE(htable->lists);
+  /* free up the buckets, including the ones from an unfinished incremental
+   * resize, and the nodes */
+  FREE(htable->heads);
+  FREE(htable->old_heads);
+  FREE(htable->nodes);
+  FREE(htable->used);
+  htable->used = NULL;
+  htable->old_heads = NULL;
+  htable->old_size = 0;
+  htable->nodes = NULL;
+  htable->nsize = 0;
+  htable->nnext = 0;
+  htable->free = -1;
 
   return TRUE;
 }
@@ -156,27 +340,113 @@ uint_t ht_count(ht_t * htable)
 
 int_t ht_insert(ht_t * htable, void * data)
 {
-  uint_t index;
-  CHECK_PTR_RET(htable, FALSE);
-  CHECK_PTR_RET(data, FALSE);
+  int_t inserted = FALSE;
 
-  /* make sure the item isn't already in the list */
-  CHECK_RET(ITR_EQ(ht_find(htable, data), ht_itr_end_t), FALSE);
+  /* fails if the item is already in the table */
+  ht_insert_or_get(htable, data, &inserted);
+
+  return inserted;
+}
+
+ht_itr_t ht_insert_or_get(ht_t * htable, void * data, int_t * inserted)
+{
+  uint_t index, hash;
+  int_t n;
+  ht_itr_t itr;
 
-  /* does the table need to grow? */
-  if ((htable->count / htable->size) > htable->limit)
-      CHECK_RET(ht_grow(htable), FALSE);
+  if (inserted != NULL)
+    *inserted = FALSE;
 
-  /* hash the data and figure out which list to add it to */
-  index = (*(htable->hfn))(data) % htable->size;
+  CHECK_PTR_RET(htable, ht_itr_end_t);
+  CHECK_PTR_RET(data, ht_itr_end_t);
+  CHECK_RET(htable->size > 0, ht_itr_end_t);
+
+  hash = (*(htable->hfn))(data);
+
+  /* move some of the old buckets over */
+  if (htable->old_heads != NULL)
+    ht_migrate(htable, HT_MIGRATE_STEP);
+
+  /* return the item if it is already in the table */
+  itr = ht_find_hash(htable, data, hash, htable->mfn);
+  if (!ITR_EQ(itr, ht_itr_end_t))
+    return itr;
+
+  if (IS_OPEN(htable))
+  {
+    /* out of never-used slots, rehash into a bigger table */
+    if (htable->growth == 0)
+      CHECK_RET(ht_grow(htable), ht_itr_end_t);
 
-  /* add the data to the appropriate list */
-  CHECK_RET(list_push_tail(LIST_AT(htable->lists, index), data), FALSE);
+    hash = ht_mix(hash);
+    index = ht_oa_free_slot(htable, hash);
+
+    /* reusing a tombstone doesn't use up any growth */
+    if (htable->ctrl[index] == HT_EMPTY)
+      htable->growth--;
+
+    htable->ctrl[index] = HT_H2(hash);
+    htable->slots[index].hash = hash;
+    htable->slots[index].data = data;
+    itr = (ht_itr_t){ .idx = index, .itr = 0 };
+  }
+  else
+  {
+    /* does the table need to grow? */
+    if ((htable->count / htable->size) > htable->limit)
+    {
+      /* finish the previous resize before starting another one */
+      ht_migrate(htable, htable->old_size);
+      CHECK_RET(ht_grow(htable), ht_itr_end_t);
+    }
+
+    n = ht_get_node(htable);
+    CHECK_RET(n >= 0, ht_itr_end_t);
+    htable->nodes[n].entry.hash = hash;
+    htable->nodes[n].entry.data = data;
+
+    /* link the node in at the head of its bucket */
+    index = ht_bucket(htable, hash, htable->size);
+    htable->nodes[n].next = htable->heads[index];
+    htable->heads[index] = n;
+    itr = (ht_itr_t){ .idx = index, .itr = n };
+  }
 
   /* update the count */
   htable->count++;
 
-  return TRUE;
+  if (inserted != NULL)
+    *inserted = TRUE;
+
+  return itr;
+}
+
+ht_itr_t ht_upsert(ht_t * htable, void * data, void ** old)
+{
+  int_t inserted = FALSE;
+  ht_itr_t itr;
+  ht_entry_t * e;
+  void * prev;
+
+  if (old != NULL)
+    *old = NULL;
+
+  itr = ht_insert_or_get(htable, data, &inserted);
+  if (inserted || ITR_EQ(itr, ht_itr_end_t))
+    return itr;
+
+  /* swap the new item in place of the matching one */
+  e = ht_entry_at(htable, itr);
+  CHECK_PTR_RET(e, ht_itr_end_t);
+  prev = e->data;
+  e->data = data;
+
+  if (old != NULL)
+    *old = prev;
+  else if ((prev != data) && (htable->dfn != NULL))
+    (*(htable->dfn))(prev);
+
+  return itr;
 }
 
 int_t ht_clear(ht_t * htable)
@@ -186,86 +456,189 @@ int_t ht_clear(ht_t * htable)
 
   /* make a copy of the htable members */
   MEMCPY(&tmp, htable, sizeof(ht_t));
-  tmp.lists = NULL;
+  tmp.heads = NULL;
+  tmp.old_heads = NULL;
+  tmp.nodes = NULL;
+  tmp.used = NULL;
 
   /* deinit, then init the table */
   CHECK_RET(ht_deinit(htable), FALSE);
-  CHECK_RET(ht_init(htable, tmp.initial, tmp.hfn, tmp.mfn, tmp.dfn), FALSE);
+  CHECK_RET(ht_init_flags(htable, tmp.initial, tmp.hfn, tmp.mfn, tmp.dfn, tmp.flags), FALSE);
 
   return TRUE;
 }
 
 ht_itr_t ht_find(ht_t const * htable, void * data)
 {
-  uint_t index;
-  ht_itr_t ret;
-  list_itr_t itr, end;
-
-  UNIT_TEST_RET(ht_find);
-
   CHECK_PTR_RET(htable, ht_itr_end_t);
   CHECK_PTR_RET(data, ht_itr_end_t);
 
-  /* get the list index */
-  index = (*(htable->hfn))(data) % htable->size;
+  return ht_find_hash(htable, data, (*(htable->hfn))(data), htable->mfn);
+}
+
+uint_t ht_find_many(ht_t const * htable, void * const * data, uint_t n,
+                    ht_itr_t * itrs)
+{
+  uint_t i, j, m, found = 0;
+  uint_t hash[HT_BATCH], index[HT_BATCH];
+  int_t head;
 
-  end = list_itr_end(LIST_AT(htable->lists, index));
-  itr = list_itr_begin(LIST_AT(htable->lists, index));
-  for(; itr != end; itr = list_itr_next(LIST_AT(htable->lists, index), itr))
+  CHECK_PTR_RET(htable, 0);
+  CHECK_PTR_RET(data, 0);
+  CHECK_PTR_RET(itrs, 0);
+
+  for (i = 0; i < n; i += HT_BATCH)
   {
-    if ((*(htable->mfn))(data, list_get(LIST_AT(htable->lists, index), itr)))
+    m = ((n - i) < HT_BATCH) ? (n - i) : HT_BATCH;
+
+    /* hash everything and start pulling in the buckets or groups */
+    for (j = 0; (htable->size > 0) && (j < m); j++)
     {
-      ret.idx = index;
-      ret.itr = itr;
-      return ret;
+      if (data[i + j] == NULL)
+        continue;
+
+      hash[j] = (*(htable->hfn))(data[i + j]);
+      if (IS_OPEN(htable))
+      {
+        index[j] = (HT_H1(ht_mix(hash[j])) & ((htable->size / HT_GROUP) - 1)) * HT_GROUP;
+        HT_PREFETCH(&htable->ctrl[index[j]]);
+        HT_PREFETCH(&htable->slots[index[j]]);
+      }
+      else
+      {
+        index[j] = ht_bucket(htable, hash[j], htable->size);
+        HT_PREFETCH(&htable->heads[index[j]]);
+      }
+    }
+
+    /* then the first node of each chain */
+    for (j = 0; !IS_OPEN(htable) && (htable->size > 0) && (j < m); j++)
+    {
+      if (data[i + j] == NULL)
+        continue;
+
+      head = htable->heads[index[j]];
+      if (head != -1)
+        HT_PREFETCH(&htable->nodes[head]);
+    }
+
+    /* by now most of the memory should be in the cache */
+    for (j = 0; j < m; j++)
+    {
+      if ((data[i + j] == NULL) || (htable->size == 0))
+      {
+        itrs[i + j] = ht_itr_end_t;
+        continue;
+      }
+
+      itrs[i + j] = ht_find_hash(htable, data[i + j], hash[j], htable->mfn);
+      if (!ITR_EQ(itrs[i + j], ht_itr_end_t))
+        found++;
     }
   }
 
-  return ht_itr_end_t;
+  return found;
+}
+
+ht_itr_t ht_find_key(ht_t const * htable, void const * key, uint_t hash,
+                     ht_key_match_fn kmfn)
+{
+  CHECK_PTR_RET(htable, ht_itr_end_t);
+  CHECK_PTR_RET(key, ht_itr_end_t);
+  CHECK_PTR_RET(kmfn, ht_itr_end_t);
+
+  return ht_find_hash(htable, key, hash, kmfn);
+}
+
+int_t ht_remove_key(ht_t * htable, void const * key, uint_t hash,
+                    ht_key_match_fn kmfn)
+{
+  ht_itr_t itr = ht_find_key(htable, key, hash, kmfn);
+  CHECK_RET(!ITR_EQ(itr, ht_itr_end_t), FALSE);
+  return ht_remove(htable, itr);
 }
 
 int_t ht_remove(ht_t * htable, ht_itr_t itr)
 {
+  ht_entry_t * e;
   CHECK_PTR_RET(htable, FALSE);
   CHECK_RET(!ITR_EQ(itr, ht_itr_end_t), FALSE);
   CHECK_RET(((itr.idx >= 0) && (itr.idx < htable->size)), FALSE);
   CHECK_RET(htable->count > 0, FALSE);
-  CHECK_PTR_RET(list_get(LIST_AT(htable->lists, itr.idx), itr.itr), FALSE);
 
-  /* remove the item from the list */
-  list_pop(LIST_AT(htable->lists, itr.idx), itr.itr);
+  if (IS_OPEN(htable))
+  {
+    CHECK_RET(itr.itr == 0, FALSE);
+    CHECK_RET(HT_IS_FULL(htable->ctrl[itr.idx]), FALSE);
+
+    /* if the group still has an empty slot, no probe ever continued past
+     * it so the slot can go back to empty instead of becoming a tombstone */
+    if (ht_group_match(&htable->ctrl[itr.idx - (itr.idx % HT_GROUP)], HT_EMPTY))
+    {
+      htable->ctrl[itr.idx] = HT_EMPTY;
+      htable->growth++;
+    }
+    else
+      htable->ctrl[itr.idx] = HT_DELETED;
+
+    htable->slots[itr.idx].data = NULL;
+    htable->count--;
+    return TRUE;
+  }
+
+  e = ht_entry_at(htable, itr);
+  CHECK_PTR_RET(e, FALSE);
+
+  /* unlink the node from its bucket, which may still be an old one during
+   * an incremental resize */
+  if (!ht_unlink(htable, &htable->heads[itr.idx], itr.itr))
+  {
+    CHECK_PTR_RET(htable->old_heads, FALSE);
+    CHECK_RET(ht_unlink(htable, &htable->old_heads[ht_bucket(htable, e->hash, htable->old_size)], itr.itr), FALSE);
+  }
+  ht_put_node(htable, itr.itr);
 
   /* update the count */
   htable->count--;
 
+  /* move some of the old buckets over, now that itr has been used */
+  if (htable->old_heads != NULL)
+    ht_migrate(htable, HT_MIGRATE_STEP);
+
   return TRUE;
 }
 
+int_t ht_rehash_step(ht_t * htable, uint_t n)
+{
+  CHECK_PTR_RET(htable, FALSE);
+  CHECK_PTR_RET(htable->old_heads, FALSE);
+
+  ht_migrate(htable, (n > 0) ? n : htable->old_size);
+
+  return (htable->old_heads != NULL);
+}
+
 void * ht_get(ht_t const * htable, ht_itr_t itr)
 {
+  ht_entry_t * e;
   CHECK_PTR_RET(htable, FALSE);
-  CHECK_RET(!ITR_EQ(itr, ht_itr_end_t), FALSE);
-  CHECK_RET(((itr.idx >= 0) && (itr.idx < htable->size)), FALSE);
 
-  return list_get(LIST_AT(htable->lists, itr.idx), itr.itr);
+  e = ht_entry_at(htable, itr);
+  CHECK_PTR_RET(e, NULL);
+  return e->data;
 }
 
 ht_itr_t ht_itr_begin(ht_t const * htable)
 {
-  int_t i = 0;
   CHECK_PTR_RET(htable, ht_itr_end_t);
   CHECK_RET(htable->size > 0, ht_itr_end_t);
   CHECK_RET(htable->count > 0, ht_itr_end_t);
 
-  /* find the first list that isn't empty */
-  while((i < htable->size) && (list_count(LIST_AT(htable->lists, i)) == 0))
-      i++;
-
-  /* if we didn't find a non-empty list, return end itr */
-  CHECK_RET(i < htable->size, ht_itr_end_t);
+  if (IS_OPEN(htable))
+    return ht_oa_scan(htable, 0, 1);
 
-  /* return an iterator to the beginning of that list */
-  return (ht_itr_t){ .idx = i, .itr = list_itr_begin(LIST_AT(htable->lists, i)) };
+  /* the nodes are walked in array order */
+  return ht_node_scan(htable, 0, 1);
 }
 
 ht_itr_t ht_itr_end(ht_t const * htable)
@@ -275,76 +648,38 @@ ht_itr_t ht_itr_end(ht_t const * htable)
 
 ht_itr_t ht_itr_rbegin(ht_t const * htable)
 {
-  int_t i = 0;
   CHECK_PTR_RET(htable, ht_itr_end_t);
   CHECK_RET(htable->size > 0, ht_itr_end_t);
   CHECK_RET(htable->count > 0, ht_itr_end_t);
-  i = htable->size;
-
-  /* scan from the end to the beginging */
-  do
-  {
-    i--;
-  } while((i >= 0) && (list_count(LIST_AT(htable->lists, i)) == 0));
 
-  /* check to see if we found a list */
-  CHECK_RET(i >= 0, ht_itr_end_t);
+  if (IS_OPEN(htable))
+    return ht_oa_scan(htable, htable->size - 1, -1);
 
-  /* return an iterator to the end of the the list we found */
-  return (ht_itr_t){ .idx = i, .itr = list_itr_rbegin(LIST_AT(htable->lists, i)) };
+  return ht_node_scan(htable, htable->nsize - 1, -1);
 }
 
 ht_itr_t ht_itr_next(ht_t const * htable, ht_itr_t itr)
 {
-  ht_itr_t ret = itr;
   CHECK_PTR_RET(htable, ht_itr_end_t);
+  CHECK_RET(((itr.idx >= 0) && (itr.idx < htable->size)), ht_itr_end_t);
 
-  /* advance the iterator */
-  ret.itr = list_itr_next(LIST_AT(htable->lists, ret.idx), ret.itr);
-
-  if (ret.itr == list_itr_end(LIST_AT(htable->lists, ret.idx)))
-  {
-    /* we need to scan for the next non-empty list */
-    do
-    {
-      ret.idx++;
-    } while((ret.idx < htable->size) &&
-            (list_count(LIST_AT(htable->lists, ret.idx)) == 0));
-
-    /* if we didn't find a non-empty list, return end itr */
-    CHECK_RET(ret.idx < htable->size, ht_itr_end_t);
+  if (IS_OPEN(htable))
+    return ht_oa_scan(htable, itr.idx + 1, 1);
 
-    /* re-initialize the list iterator */
-    ret.itr = list_itr_begin(LIST_AT(htable->lists, ret.idx));
-  }
-
-  return ret;
+  CHECK_RET(((itr.itr >= 0) && (itr.itr < htable->nsize)), ht_itr_end_t);
+  return ht_node_scan(htable, itr.itr + 1, 1);
 }
 
 ht_itr_t ht_itr_rnext(ht_t const * htable, ht_itr_t itr)
 {
-  ht_itr_t ret = itr;
   CHECK_PTR_RET(htable, ht_itr_end_t);
+  CHECK_RET(((itr.idx >= 0) && (itr.idx < htable->size)), ht_itr_end_t);
 
-  /* advance the iterator */
-  ret.itr = list_itr_rnext(LIST_AT(htable->lists, ret.idx), ret.itr);
-
-  if (ret.itr == list_itr_end(LIST_AT(htable->lists, ret.idx)))
-  {
-    /* we need to scan for the next non-empty list */
-    do
-    {
-      ret.idx--;
-    } while((ret.idx >= 0) && (list_count(LIST_AT(htable->lists, ret.idx)) == 0));
-
-    /* check if we found a list */
-    CHECK_RET(ret.idx >= 0, ht_itr_end_t);
-
-    /* re-initialize the list iterator */
-    ret.itr = list_itr_rbegin(LIST_AT(htable->lists, ret.idx));
-  }
+  if (IS_OPEN(htable))
+    return ht_oa_scan(htable, itr.idx - 1, -1);
 
-  return ret;
+  CHECK_RET(((itr.itr >= 0) && (itr.itr < htable->nsize)), ht_itr_end_t);
+  return ht_node_scan(htable, itr.itr - 1, -1);
 }
 
 
@@ -367,64 +702,400 @@ static uint_t ht_get_new_size(uint_t count, float limit)
   return PRIMES[index];
 }
 
+/* power of two version of ht_get_new_size, never less than 2 so that the
+ * shift in ht_bucket stays under 64 */
+static uint_t ht_get_pow2_size(uint_t count, float limit)
+{
+  uint_t size = 2;
+
+  while((size < (((uint_t)-1 >> 1) + 1)) && (((float)count / (float)size) > limit))
+    size <<= 1;
+
+  return size;
+}
+
 static int_t ht_grow(ht_t * htable)
 {
-  uint_t i, count, new_size, old_size;
-  list_t *new_lists, *old_lists;
+  uint_t i, count, new_size, index;
+  int_t * new_heads;
 
   UNIT_TEST_RET(ht_grow);
 
   CHECK_PTR_RET(htable, FALSE);
 
+  if (IS_OPEN(htable))
+    return ht_oa_grow(htable);
+
   /* if it's empty, then use the initial capacity */
   count = htable->count ? htable->count : htable->initial;
 
   /* figure out the new size from the count */
-  new_size = ht_get_new_size(count, htable->limit);
+  new_size = (htable->flags & HT_POW2) ? ht_get_pow2_size(count, htable->limit) :
+                                         ht_get_new_size(count, htable->limit);
 
-  /* remember some stuff */
-  old_size = htable->size;
-  old_lists = htable->lists;
+  /* allocate the new bucket array, all empty */
+  new_heads = CALLOC(new_size, sizeof(int_t));
+  CHECK_PTR_RET(new_heads, FALSE);
+  MEMSET(new_heads, 0xFF, new_size * sizeof(int_t));
 
-  /* allocate the new list array */
-  new_lists = CALLOC(new_size, sizeof(list_t));
-  CHECK_PTR_RET(new_lists, FALSE);
+  /* incremental tables hang on to the old buckets and move them a few at a
+   * time in ht_insert */
+  if ((htable->flags & HT_INCREMENTAL) && (htable->size > 0))
+  {
+    htable->old_size = htable->size;
+    htable->old_heads = htable->heads;
+    htable->migrate = 0;
+    htable->size = new_size;
+    htable->heads = new_heads;
+    return TRUE;
+  }
 
-  /* initialize the lists */
-  for (i = 0; i < new_size; i++)
+  /* relink every used node into the new buckets using its stored hash */
+  for (i = 0; i < htable->nnext; i++)
   {
-    if (!list_init(LIST_AT(new_lists, i), 0, htable->dfn))
+    if (htable->nodes[i].entry.data == NULL)
+      continue;
+
+    index = ht_bucket(htable, htable->nodes[i].entry.hash, new_size);
+    htable->nodes[i].next = new_heads[index];
+    new_heads[index] = i;
+  }
+
+  /* free up the old bucket array */
+  FREE(htable->heads);
+  htable->size = new_size;
+  htable->heads = new_heads;
+
+  return TRUE;
+}
+
+/* moves up to n of the old buckets into the new buckets */
+static void ht_migrate(ht_t * htable, uint_t n)
+{
+  int_t i, * old;
+  uint_t index;
+
+  for (; (n > 0) && (htable->migrate < htable->old_size); n--, htable->migrate++)
+  {
+    old = &htable->old_heads[htable->migrate];
+    while (*old != -1)
     {
-      FREE(new_lists);
-      return FALSE;
+      i = *old;
+      *old = htable->nodes[i].next;
+
+      index = ht_bucket(htable, htable->nodes[i].entry.hash, htable->size);
+      htable->nodes[i].next = htable->heads[index];
+      htable->heads[index] = i;
     }
   }
 
-  /* set up the hash table with the empty lists */
-  htable->count = 0;
+  /* all moved, free up the old bucket array */
+  if ((htable->old_heads != NULL) && (htable->migrate == htable->old_size))
+  {
+    FREE(htable->old_heads);
+    htable->old_heads = NULL;
+    htable->old_size = 0;
+    htable->migrate = 0;
+  }
+}
+
+/* returns the entry at the iterator position in either layout */
+static ht_entry_t * ht_entry_at(ht_t const * htable, ht_itr_t itr)
+{
+  CHECK_RET(!ITR_EQ(itr, ht_itr_end_t), NULL);
+  CHECK_RET(((itr.idx >= 0) && (itr.idx < htable->size)), NULL);
+
+  if (IS_OPEN(htable))
+  {
+    CHECK_RET(itr.itr == 0, NULL);
+    CHECK_RET(HT_IS_FULL(htable->ctrl[itr.idx]), NULL);
+    return &htable->slots[itr.idx];
+  }
+
+  CHECK_RET(((itr.itr >= 0) && (itr.itr < htable->nnext)), NULL);
+  CHECK_PTR_RET(htable->nodes[itr.itr].entry.data, NULL);
+  return &htable->nodes[itr.itr].entry;
+}
+
+/* looks up key with the caller's (unmixed) hash in either layout */
+static ht_itr_t ht_find_hash(ht_t const * htable, void const * key, uint_t hash,
+                             ht_key_match_fn match)
+{
+  uint_t index, old;
+  int_t n;
+  ht_itr_t ret;
+
+  /* ht_insert and ht_find_key look up through here too */
+  UNIT_TEST_RET(ht_find);
+
+  CHECK_RET(htable->size > 0, ht_itr_end_t);
+
+  if (IS_OPEN(htable))
+  {
+    ret.idx = ht_oa_find(htable, key, ht_mix(hash), match);
+    CHECK_RET(ret.idx >= 0, ht_itr_end_t);
+    ret.itr = 0;
+    return ret;
+  }
+
+  /* walk the bucket's chain */
+  index = ht_bucket(htable, hash, htable->size);
+  n = ht_find_chain(htable, htable->heads[index], key, hash, match);
+
+  /* during an incremental resize it may not have been moved yet */
+  if ((n < 0) && (htable->old_heads != NULL))
+  {
+    old = ht_bucket(htable, hash, htable->old_size);
+    if (old >= htable->migrate)
+      n = ht_find_chain(htable, htable->old_heads[old], key, hash, match);
+  }
+
+  CHECK_RET(n >= 0, ht_itr_end_t);
+  return (ht_itr_t){ .idx = index, .itr = n };
+}
+
+/* returns the node matching key in the chain starting at n or -1.  the
+ * match function is only called on nodes with the same hash. */
+static int_t ht_find_chain(ht_t const * htable, int_t n, void const * key,
+                           uint_t hash, ht_key_match_fn match)
+{
+  ht_node_t const * node;
+
+  for (; n != -1; n = node->next)
+  {
+    node = &htable->nodes[n];
+    if ((node->entry.hash == hash) && (*match)(key, node->entry.data))
+      return n;
+  }
+
+  return -1;
+}
+
+/* removes node n from the chain at head, returns FALSE if it isn't there */
+static int_t ht_unlink(ht_t * htable, int_t * head, int_t n)
+{
+  int_t * link;
+
+  for (link = head; *link != -1; link = &htable->nodes[*link].next)
+  {
+    if (*link == n)
+    {
+      *link = htable->nodes[n].next;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* returns an iterator to the first used node at or past i going in the
+ * direction dir.  the used bitmap is scanned a word at a time so runs of
+ * free nodes are skipped 64 at a time.  the bucket is the one the node
+ * hashes to in the current bucket array. */
+static ht_itr_t ht_node_scan(ht_t const * htable, int_t i, int_t dir)
+{
+  int_t w;
+  uint64_t bits;
+
+  CHECK_RET((i >= 0) && (i < (int_t)htable->nsize), ht_itr_end_t);
+
+  w = i / 64;
+  if (dir > 0)
+  {
+    /* ignore the nodes below i in the first word */
+    bits = htable->used[w] & (~0ULL << (i % 64));
+    while ((bits == 0) && (++w < (int_t)HT_WORDS(htable->nsize)))
+      bits = htable->used[w];
+    CHECK_RET(bits != 0, ht_itr_end_t);
+    i = (w * 64) + ht_ctz(bits);
+  }
+  else
+  {
+    /* ignore the nodes above i in the first word */
+    bits = htable->used[w] & (~0ULL >> (63 - (i % 64)));
+    while ((bits == 0) && (--w >= 0))
+      bits = htable->used[w];
+    CHECK_RET(bits != 0, ht_itr_end_t);
+    i = (w * 64) + ht_msb(bits);
+  }
+
+  return (ht_itr_t){ .idx = ht_bucket(htable, htable->nodes[i].entry.hash, htable->size), .itr = i };
+}
+
+/* takes a node off the free list, or the next never used one, doubling the
+ * node array when they run out.  the new nodes are handed out in order
+ * instead of being threaded onto the free list so that growing doesn't touch
+ * every one of them.  returns -1 on failure. */
+static int_t ht_get_node(ht_t * htable)
+{
+  int_t n;
+  uint_t nsize;
+  ht_node_t * nodes;
+  uint64_t * used;
+
+  if (htable->free != -1)
+  {
+    n = htable->free;
+    htable->free = htable->nodes[n].next;
+    htable->used[n / 64] |= (1ULL << (n % 64));
+    return n;
+  }
+
+  if (htable->nnext == htable->nsize)
+  {
+    nsize = (htable->nsize > 0) ? (htable->nsize * 2) : HT_NODE_MIN;
+    nodes = REALLOC(htable->nodes, nsize * sizeof(ht_node_t));
+    CHECK_PTR_RET(nodes, -1);
+    htable->nodes = nodes;
+
+    used = REALLOC(htable->used, HT_WORDS(nsize) * sizeof(uint64_t));
+    CHECK_PTR_RET(used, -1);
+    htable->used = used;
+    MEMSET(&used[HT_WORDS(htable->nsize)], 0,
+           (HT_WORDS(nsize) - HT_WORDS(htable->nsize)) * sizeof(uint64_t));
+    htable->nsize = nsize;
+  }
+
+  n = htable->nnext++;
+  htable->used[n / 64] |= (1ULL << (n % 64));
+  return n;
+}
+
+static void ht_put_node(ht_t * htable, int_t n)
+{
+  htable->nodes[n].entry.data = NULL;
+  htable->nodes[n].next = htable->free;
+  htable->free = n;
+  htable->used[n / 64] &= ~(1ULL << (n % 64));
+}
+
+static int_t ht_oa_grow(ht_t * htable)
+{
+  uint_t i, want, new_size, old_size;
+  uint8_t *new_ctrl, *old_ctrl;
+  ht_entry_t *new_slots, *old_slots;
+
+  /* size for twice the live items so that a table full of tombstones gets
+   * rehashed in place and a full table doubles */
+  want = htable->count ? (htable->count * 2) : htable->initial;
+  new_size = HT_GROUP;
+  while ((HT_MAX_LOAD(new_size) < want) && (new_size < (((uint_t)-1 >> 1) + 1)))
+    new_size <<= 1;
+
+  new_ctrl = CALLOC(new_size, sizeof(uint8_t));
+  CHECK_PTR_RET(new_ctrl, FALSE);
+  new_slots = CALLOC(new_size, sizeof(ht_entry_t));
+  if (new_slots == NULL)
+  {
+    FREE(new_ctrl);
+    return FALSE;
+  }
+  MEMSET(new_ctrl, HT_EMPTY, new_size);
+
+  /* remember some stuff */
+  old_size = htable->size;
+  old_ctrl = htable->ctrl;
+  old_slots = htable->slots;
+
   htable->size = new_size;
-  htable->lists = new_lists;
+  htable->ctrl = new_ctrl;
+  htable->slots = new_slots;
 
-  /* hash the old data into the new table */
+  /* move the live items over, the new table has no duplicates or
+   * tombstones so there's no need to look before placing */
   for (i = 0; i < old_size; i++)
   {
-    while(list_count(LIST_AT(old_lists, i)))
-    {
-      /* hash the data item into the new table */
-      ht_insert(htable, list_get_head(LIST_AT(old_lists, i)));
+    uint_t hash, index;
+    if (!HT_IS_FULL(old_ctrl[i]))
+      continue;
+
+    hash = old_slots[i].hash;
+    index = ht_oa_free_slot(htable, hash);
+    new_ctrl[index] = HT_H2(hash);
+    new_slots[index] = old_slots[i];
+  }
+  htable->growth = HT_MAX_LOAD(new_size) - htable->count;
+
+  FREE(old_ctrl);
+  FREE(old_slots);
+
+  return TRUE;
+}
 
-      /* remove the data item from the old list */
-      list_pop_head(LIST_AT(old_lists, i));
+/* returns the slot holding a match for key or -1 */
+static int_t ht_oa_find(ht_t const * htable, void const * key, uint_t hash,
+                        ht_key_match_fn match)
+{
+  uint_t i, g, bits, mask = (htable->size / HT_GROUP) - 1;
+  uint8_t const * ctrl;
+
+  /* quadratic probe over whole groups, visits every group when the group
+   * count is a power of two */
+  g = HT_H1(hash) & mask;
+  for (i = 0; i <= mask; i++)
+  {
+    ctrl = &htable->ctrl[g * HT_GROUP];
+    for (bits = ht_group_match(ctrl, HT_H2(hash)); bits; bits &= (bits - 1))
+    {
+      uint_t slot = (g * HT_GROUP) + ht_ctz(bits);
+      if ((htable->slots[slot].hash == hash) &&
+          (*match)(key, htable->slots[slot].data))
+        return (int_t)slot;
     }
 
-    /* free up the list memory */
-    list_deinit(LIST_AT(old_lists, i));
+    /* an empty slot ends the probe sequence */
+    if (ht_group_match(ctrl, HT_EMPTY))
+      return -1;
+
+    g = (g + i + 1) & mask;
   }
 
-  /* free up the old lists array */
-  FREE(old_lists);
+  return -1;
+}
 
-  return TRUE;
+/* returns the first empty or deleted slot on the probe sequence for hash.
+ * the caller makes sure there is one by keeping growth > 0. */
+static uint_t ht_oa_free_slot(ht_t const * htable, uint_t hash)
+{
+  uint_t i, g, bits, mask = (htable->size / HT_GROUP) - 1;
+
+  g = HT_H1(hash) & mask;
+  for (i = 0; i <= mask; i++)
+  {
+    bits = ht_group_free(&htable->ctrl[g * HT_GROUP]);
+    if (bits)
+      return (g * HT_GROUP) + ht_ctz(bits);
+    g = (g + i + 1) & mask;
+  }
+
+  assert(0);
+  return 0;
+}
+
+/* returns an iterator to the first full slot at or past i going in the
+ * direction dir.  the control bytes are checked a group at a time. */
+static ht_itr_t ht_oa_scan(ht_t const * htable, int_t i, int_t dir)
+{
+  int_t g;
+  uint32_t bits;
+
+  CHECK_RET((i >= 0) && (i < (int_t)htable->size), ht_itr_end_t);
+
+  g = i / HT_GROUP;
+  if (dir > 0)
+  {
+    bits = ~ht_group_free(&htable->ctrl[g * HT_GROUP]) & (0xFFFFU << (i % HT_GROUP)) & 0xFFFFU;
+    while ((bits == 0) && (++g < (int_t)(htable->size / HT_GROUP)))
+      bits = ~ht_group_free(&htable->ctrl[g * HT_GROUP]) & 0xFFFFU;
+    CHECK_RET(bits != 0, ht_itr_end_t);
+    return (ht_itr_t){ .idx = (g * HT_GROUP) + ht_ctz(bits), .itr = 0 };
+  }
+
+  bits = ~ht_group_free(&htable->ctrl[g * HT_GROUP]) & (0xFFFFU >> (HT_GROUP - 1 - (i % HT_GROUP)));
+  while ((bits == 0) && (--g >= 0))
+    bits = ~ht_group_free(&htable->ctrl[g * HT_GROUP]) & 0xFFFFU;
+  CHECK_RET(bits != 0, ht_itr_end_t);
+  return (ht_itr_t){ .idx = (g * HT_GROUP) + ht_msb(bits), .itr = 0 };
 }
 
 
@@ -434,21 +1105,27 @@ static int_t ht_grow(ht_t * htable)
 
 void test_hashtable_private_functions(void)
 {
+  uint_t i;
   ht_t ht;
   MEMSET(&ht, 0, sizeof(ht_t));
 
   /* ht_get_new_size */
   CU_ASSERT_EQUAL(ht_get_new_size((uint_t)-1, 0.1), 1610612741);
+  for (i = 1; i < NUM_PRIMES; i++)
+  {
+    CU_ASSERT_TRUE(PRIMES[i] > PRIMES[i - 1]);
+  }
+
+  /* ht_get_pow2_size */
+  CU_ASSERT_EQUAL(ht_get_pow2_size(0, 3.0f), 2);
+  CU_ASSERT_EQUAL(ht_get_pow2_size(100, 3.0f), 64);
+  CU_ASSERT_EQUAL(ht_get_pow2_size((uint_t)-1, 0.1), ((uint_t)-1 >> 1) + 1);
 
   /* ht_grow */
   CU_ASSERT_FALSE(ht_grow(NULL));
   fail_alloc = TRUE;
   CU_ASSERT_FALSE(ht_grow(&ht));
   fail_alloc = FALSE;
-  fake_list_init = TRUE;
-  fake_list_init_ret = FALSE;
-  CU_ASSERT_FALSE(ht_grow(&ht));
-  fake_list_init = FALSE;
 }
 
 #endif
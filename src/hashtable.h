@@ -34,8 +34,8 @@
 /* iterator type */
 typedef struct ht_itr_s
 {
-  int_t               idx;          /* index of the list */
-  list_itr_t          itr;          /* list iterator */
+  int_t               idx;          /* index of the bucket or slot */
+  list_itr_t          itr;          /* index of the node (chained) */
 } ht_itr_t;
 
 #define ITR_EQ(i, j) ((i.idx == j.idx) && (i.itr == j.itr))
@@ -47,9 +47,50 @@ typedef uint_t (*ht_hash_fn)(void const * key);
  * it must return 1 if the data matches, 0 otherwise */
 typedef int_t (*ht_match_fn)(void const * l, void const * r);
 
+/* key match function prototype for ht_find_key()/ht_remove_key().  it is
+ * passed the caller's key and a stored item and must return 1 if they
+ * match, 0 otherwise */
+typedef int_t (*ht_key_match_fn)(void const * key, void const * data);
+
 /* the delete function prototype */
 typedef void (*ht_delete_fn)(void * value);
 
+/* a stored item and its hash.  the hash is computed once on insert and
+ * reused by lookups and resizes. */
+typedef struct ht_entry_s
+{
+  uint_t              hash;         /* hash of data */
+  void*               data;         /* the item */
+} ht_entry_t;
+
+/* a chained item.  all of a table's nodes live in one array and are linked
+ * into their bucket, or the free list, by index. */
+typedef struct ht_node_s
+{
+  ht_entry_t          entry;        /* the item, data is NULL when free */
+  int_t               next;         /* next node or -1 */
+} ht_node_t;
+
+/* table layout flags passed to ht_new_flags()/ht_init_flags().  the default
+ * is separate chaining with the nodes in one array.  HT_OPEN_ADDRESSED stores the
+ * items in one slot array probed 16 control bytes at a time (swiss table
+ * style).  both layouts have the same interface, but in the open addressed
+ * layout an iterator is only valid until the next insert. */
+#define HT_CHAINED        (0)
+#define HT_OPEN_ADDRESSED (1<<0)
+
+/* with HT_INCREMENTAL a chained table doesn't rehash everything at once when
+ * it grows.  it keeps the old bucket array and each insert or remove moves a
+ * few of the old buckets over.  lookups and iteration see both arrays until
+ * the move is finished, so tables that are mostly read can finish it with
+ * ht_rehash_step().  it has no effect on the open addressed layout. */
+#define HT_INCREMENTAL    (1<<1)
+
+/* with HT_POW2 a chained table uses power of two sizes and picks the bucket
+ * with a multiply and shift (fibonacci hashing) instead of a modulo by a
+ * prime.  the open addressed layout always works this way. */
+#define HT_POW2           (1<<2)
+
 /* the hash table structure */
 typedef struct ht_s
 {
@@ -59,18 +100,35 @@ typedef struct ht_s
   uint_t              initial;      /* initial capacity */
   float               limit;        /* load limit that will trigger resize */
   uint_t              count;        /* number of items in the hashtable */
-  uint_t              size;         /* the size of the list array */
-  list_t*             lists;        /* pointer to list array */
+  uint_t              size;         /* the number of buckets or slots */
+  int_t*              heads;        /* first node in each bucket (chained) */
+  ht_node_t*          nodes;        /* node array (chained) */
+  uint_t              nsize;        /* size of the node array (chained) */
+  uint_t              nnext;        /* nodes below this have been used (chained) */
+  int_t               free;         /* first free node (chained) */
+  uint64_t*           used;         /* bitmap of used nodes (chained) */
+  uint_t              flags;        /* layout flags */
+  uint8_t*            ctrl;         /* control bytes (open addressed) */
+  ht_entry_t*         slots;        /* slot array (open addressed) */
+  uint_t              growth;       /* inserts left before a resize (open addressed) */
+  uint_t              old_size;     /* size of the bucket array being moved (incremental) */
+  int_t*              old_heads;    /* bucket array being moved (incremental) */
+  uint_t              migrate;      /* next old bucket to move (incremental) */
 } ht_t;
 
 /* heap allocated hash table */
 ht_t* ht_new(uint_t initial_capacity, ht_hash_fn hfn,
               ht_match_fn mfn, ht_delete_fn dfn);
+ht_t* ht_new_flags(uint_t initial_capacity, ht_hash_fn hfn,
+                   ht_match_fn mfn, ht_delete_fn dfn, uint_t flags);
 void ht_delete(void * ht);
 
 /* stack allocated hash table */
 int_t ht_init(ht_t * htable, uint_t initial_capacity,
               ht_hash_fn hfn, ht_match_fn mfn, ht_delete_fn dfn);
+int_t ht_init_flags(ht_t * htable, uint_t initial_capacity,
+                    ht_hash_fn hfn, ht_match_fn mfn, ht_delete_fn dfn,
+                    uint_t flags);
 int_t ht_deinit(ht_t * htable);
 
 /* returns the number of items stored in the hashtable */
@@ -79,15 +137,45 @@ uint_t ht_count(ht_t * htable);
 /* inserts the given data into the hash table */
 int_t ht_insert(ht_t * htable, void * data);
 
+/* finds data or inserts it if it isn't there, hashing and probing once.
+ * returns an iterator to the existing or new item and sets *inserted to
+ * TRUE if data was inserted.  returns the end iterator on failure. */
+ht_itr_t ht_insert_or_get(ht_t * htable, void * data, int_t * inserted);
+
+/* inserts data, replacing a matching item if there is one.  the replaced
+ * item is returned through old if it isn't NULL, otherwise it is deleted
+ * with the table's delete function. */
+ht_itr_t ht_upsert(ht_t * htable, void * data, void ** old);
+
 /* clears all data from the hash table */
 int_t ht_clear(ht_t * htable);
 
 /* finds the corresponding data in the hash table */
 ht_itr_t ht_find(ht_t const * htable, void * data);
 
+/* looks up n items at once, storing an iterator for each in itrs (the end
+ * iterator for a miss).  all of the hashes are computed and the buckets
+ * prefetched before any are searched, which hides cache misses across the
+ * batch.  returns the number of items found. */
+uint_t ht_find_many(ht_t const * htable, void * const * data, uint_t n,
+                    ht_itr_t * itrs);
+
+/* finds the item matching key without needing an item shaped probe.  hash
+ * must be the value the table's hash function returns for matching items. */
+ht_itr_t ht_find_key(ht_t const * htable, void const * key, uint_t hash,
+                     ht_key_match_fn kmfn);
+
+/* removes the item matching key, the item itself isn't deleted */
+int_t ht_remove_key(ht_t * htable, void const * key, uint_t hash,
+                    ht_key_match_fn kmfn);
+
 /* remove the key/value at the specified iterator position */
 int_t ht_remove(ht_t * htable, ht_itr_t itr);
 
+/* moves up to n of the old buckets over during an incremental resize, or
+ * all of them if n is 0.  returns TRUE if there are still some left. */
+int_t ht_rehash_step(ht_t * htable, uint_t n);
+
 /* get the data at the given iterator position */
 void* ht_get(ht_t const * htable, ht_itr_t itr);
 
@@ -101,4 +189,47 @@ ht_itr_t ht_itr_rnext(ht_t const * htable, ht_itr_t itr);
 #define ht_itr_prev(h,i) ht_itr_rnext(h,i)
 #define ht_itr_rprev(h,i) ht_itr_next(h,i)
 
+/* unchecked access.  HT_GET does no argument checking so itr must point at
+ * an item.  HT_FOREACH sets item, which may be any pointer type, to each item
+ * in turn using i, a uint_t, as the cursor.  the table must not be modified
+ * inside the loop. */
+#define HT_GET(htable, itr) \
+  (((htable)->flags & HT_OPEN_ADDRESSED) ? \
+   (htable)->slots[(itr).idx].data : (htable)->nodes[(itr).itr].entry.data)
+#define HT_FOREACH(htable, i, item) \
+  for ((i) = 0; ((item) = ht_foreach_next((htable), &(i))) != NULL; (i)++)
+
+/* returns the first item at or after cursor *i for HT_FOREACH, or NULL when
+ * there are no more.  stored items are never NULL. */
+static inline void * ht_foreach_next(ht_t const * htable, uint_t * i)
+{
+  uint64_t bits;
+
+  if (htable->flags & HT_OPEN_ADDRESSED)
+  {
+    /* full slots have the top control bit clear */
+    for (; *i < htable->size; (*i)++)
+    {
+      if ((htable->ctrl[*i] & 0x80) == 0)
+        return htable->slots[*i].data;
+    }
+    return NULL;
+  }
+
+  for (; *i < htable->nnext; (*i)++)
+  {
+    /* skip the rest of the bitmap word if it has no more used nodes */
+    bits = htable->used[*i / 64] >> (*i % 64);
+    if (bits == 0)
+    {
+      *i |= 63;
+      continue;
+    }
+
+    if (bits & 1)
+      return htable->nodes[*i].entry.data;
+  }
+  return NULL;
+}
+
 #endif /*HASHTABLE_H*/
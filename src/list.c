@@ -37,24 +37,29 @@
 #include "test_flags.h"
 #endif
 
-/* node used in queue structure */
-struct list_item_s
-{
-  int_t   next;   /* next node in the list */
-  int_t   prev;   /* prev node in the list */
-  int_t   used;   /* bool to mark used nodes */
-  void *  data;   /* pointer to the data */
-};
+/* links are 32-bit so that is the most nodes a list can have */
+#define LIST_MAX_SIZE (INT32_MAX)
+
+#define LINK_AT(links, index) (&(links[index]))
+
+/* true while the nodes live in the list struct */
+#define IS_INLINE(list) ((list)->links == (list)->inline_links)
 
-#define ITEM_AT(items, index) (&(items[index]))
+/* used bitmap helpers */
+#define USED_WORDS(n) (((n) + 63) / 64)
+#define IS_USED(list, i) (((list)->used[(i) / 64] >> ((i) % 64)) & 1)
+#define SET_USED(list, i) ((list)->used[(i) / 64] |= ((uint64_t)1 << ((i) % 64)))
+#define CLR_USED(list, i) ((list)->used[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
 
 /* index constants */
 list_itr_t const list_itr_end_t = -1;
 
 /* forward declaration of private functions */
-static list_itr_t remove_item(list_item_t * items, list_itr_t itr);
-static list_itr_t insert_item(list_item_t * items, list_itr_t itr, list_itr_t item);
+static list_itr_t remove_item(list_link_t * links, list_itr_t itr);
+static list_itr_t insert_item(list_link_t * links, list_itr_t itr, list_itr_t item);
 static int_t list_grow(list_t * list, uint_t amount);
+static void push_item(list_t * list, void * data, list_itr_t itr);
+static list_itr_t pop_item(list_t * list, list_itr_t item);
 
 
 /********** PUBLIC **********/
@@ -90,7 +95,10 @@ int_t list_init(list_t * list, uint_t initial_capacity, list_delete_fn dfn)
   list->count = 0;
   list->used_head = list_itr_end_t;
   list->free_head = list_itr_end_t;
-  list->items = NULL;
+  list->links = NULL;
+  list->data = NULL;
+  list->used = NULL;
+  list->inline_used = 0;
 
   /* grow the list array if needed */
   CHECK_RET(list_grow(list, initial_capacity), FALSE);
@@ -116,7 +124,7 @@ int_t list_deinit(list_t * list)
     for(itr = list_itr_begin(list); itr != end; itr = list_itr_next(list, itr))
     {
       /* call the delete function on the data at the node */
-      (*(list->dfn))(ITEM_AT(list->items, itr)->data);
+      (*(list->dfn))(list->data[itr]);
     }
   }
 
@@ -127,12 +135,16 @@ int_t list_deinit(list_t * list)
   list->used_head = list_itr_end_t;
   list->free_head = list_itr_end_t;
 
-  /* free the items array */
-  if (list->items != NULL)
+  /* free the node arrays unless the nodes are still inline */
+  if (!IS_INLINE(list))
   {
-    FREE(list->items);
-    list->items = NULL;
+    FREE(list->links);
+    FREE(list->data);
+    FREE(list->used);
   }
+  list->links = NULL;
+  list->data = NULL;
+  list->used = NULL;
 
   return TRUE;
 }
@@ -190,7 +202,7 @@ list_itr_t list_itr_tail(list_t const * list)
   CHECK_RET(list->count, list_itr_end_t);
 
   /* the list is circular so just return the head's prev item index */
-  return ITEM_AT(list->items, list->used_head)->prev;
+  return LINK_AT(list->links, list->used_head)->prev;
 }
 
 list_itr_t list_itr_next(list_t const * list, list_itr_t itr)
@@ -200,8 +212,8 @@ list_itr_t list_itr_next(list_t const * list, list_itr_t itr)
 
   /* if the next item in the list isn't the head, return its index.
    * otherwise we're at the end of the list, return the end itr */
-  return (ITEM_AT(list->items, itr)->next != list->used_head) ?
-          ITEM_AT(list->items, itr)->next :
+  return (LINK_AT(list->links, itr)->next != list->used_head) ?
+          LINK_AT(list->links, itr)->next :
           list_itr_end_t;
 }
 
@@ -213,99 +225,47 @@ list_itr_t list_itr_rnext(list_t const * list, list_itr_t itr)
   /* if the iterator isn't the head, return the previous item index.
    * otherwise we're at the reverse end of the list, return the end itr */
   return (itr != list->used_head) ?
-          ITEM_AT(list->items, itr)->prev :
+          LINK_AT(list->links, itr)->prev :
           list_itr_end_t;
 }
 
 int_t list_push(list_t * list, void * data, list_itr_t itr)
 {
-  int_t i = 0;
-  list_itr_t tmp = list_itr_end_t;
-  list_itr_t item = list_itr_end_t;
-  list_itr_t before = itr;
-  list_itr_t the_head = list_itr_end_t;
-
   UNIT_TEST_RET(list_push);
 
   CHECK_PTR_RET(list, FALSE);
 
-  /* remember what the list head currently is */
-  the_head = list->used_head;
-
-  /* do we need to resize to accomodate this node? */
+  /* do we need to resize to accomodate this node?  growing keeps every
+   * item at its index so itr is still good afterwards. */
   if (list->count == list->size)
   {
-    /* if there already items in the list, we need to figure out where
-      * in the list the item at itr is so that we can adjust itr to be correct
-      * after the list is grown since list_grow moves items around in memory. */
-    if ((list->count > 0) && (itr != list_itr_end_t))
-    {
-      tmp = list->used_head;
-      while((tmp != itr) && (i < list->count))
-      {
-        i++;
-        tmp = list->items[tmp].next;
-      }
-      CHECK_RET(i != list->count, FALSE);
-    }
-
     CHECK_RET(list_grow(list, 1), FALSE);
-
-    /* now set the before iterator to the correct location */
-    if ((list->count > 0) && (itr != list_itr_end_t))
-    {
-      before = list->used_head;
-      while(i > 0)
-      {
-        before = list->items[before].next;
-        i--;
-      }
-    }
   }
 
-  /* get an item from the free list */
-  item = list->free_head;
-  list->free_head = remove_item(list->items, list->free_head);
+  push_item(list, data, itr);
 
-  /* store the data pointer over */
-  ITEM_AT(list->items, item)->data = data;
-  ITEM_AT(list->items, item)->used = TRUE;
+  return TRUE;
+}
 
-  /* if itr is list_itr_end_t, then we want to insert at the end of the list
-    * which is just before the head... but if the list is empty, we need to
-    * make sure that list_itr_end_t passes through */
-  if (list->count > 0)
-  {
-    if (itr == list_itr_end_t)
-    {
-      /* insert before the head but don't update the used_head, this puts
-        * the item at the tail of the list */
-      before = list->used_head;
-      insert_item(list->items, before, item);
-    }
-    else
-    {
-      /* if we are inserting before the head, then update used_head so that
-        * the item is now the head of the list...otherwise, insert it into the
-        * list and don't update the used_head. */
-      if (itr == the_head)
-      {
-        insert_item(list->items, list->used_head, item);
-        list->used_head = item;
-      }
-      else
-        insert_item(list->items, before, item);
-    }
-  }
-  else
+int_t list_push_many(list_t * list, void * const * data, uint_t n, list_itr_t itr)
+{
+  uint_t i;
+
+  CHECK_PTR_RET(list, FALSE);
+  CHECK_RET(n, TRUE);
+  CHECK_PTR_RET(data, FALSE);
+  CHECK_RET(((itr == list_itr_end_t) ||
+             ((itr >= 0) && (itr < list->size) && IS_USED(list, itr))), FALSE);
+
+  /* make room for all of them up front */
+  CHECK_RET(list_reserve(list, list->count + n), FALSE);
+
+  /* pushing each one before itr keeps them in order */
+  for (i = 0; i < n; i++)
   {
-    /* insert into an empty list, update the used_head */
-    list->used_head = insert_item(list->items, before, item);
+    push_item(list, data[i], itr);
   }
 
-  /* update the count */
-  list->count++;
-
   return TRUE;
 }
 
@@ -326,28 +286,66 @@ list_itr_t list_pop(list_t * list, list_itr_t itr)
   item = (itr == list_itr_end_t) ? list_itr_tail(list) : itr;
 
   /* make sure their iterator references an item in the used list */
-  CHECK_RET(ITEM_AT(list->items, item)->used, list_itr_end_t);
-
-  /* remove the item from the used list */
-  next = remove_item(list->items, item);
+  CHECK_RET(IS_USED(list, item), list_itr_end_t);
 
-  /* if we removed the head, update the used_head iterator */
-  if (item == list->used_head)
-    list->used_head = next;
-
-  /* reset the item and put it onto the free list */
-  ITEM_AT(list->items, item)->data = NULL;
-  ITEM_AT(list->items, item)->used = FALSE;
-  list->free_head = insert_item(list->items, list->free_head, item);
-
-  /* update the count */
-  list->count--;
+  next = pop_item(list, item);
 
   /* if we popped the tail, then we need to return list_itr_end_t, otherwise
    * we return the iterator of the next item in the list */
   return (itr == list_itr_end_t) ? list_itr_end_t : next;
 }
 
+uint_t list_pop_many(list_t * list, list_itr_t itr, void ** data, uint_t n)
+{
+  uint_t i;
+  list_itr_t next;
+
+  CHECK_PTR_RET(list, 0);
+  CHECK_PTR_RET(data, 0);
+  CHECK_RET(((itr >= 0) && (itr < list->size) && IS_USED(list, itr)), 0);
+
+  for (i = 0; (i < n) && (itr != list_itr_end_t); i++)
+  {
+    data[i] = list->data[itr];
+    next = LIST_ITR_NEXT(list, itr);
+    pop_item(list, itr);
+    itr = next;
+  }
+
+  return i;
+}
+
+uint_t list_splice(list_t * dst, list_itr_t itr, list_t * src,
+                   list_itr_t first, uint_t n)
+{
+  uint_t i;
+  void * data;
+  list_itr_t next;
+
+  CHECK_PTR_RET(dst, 0);
+  CHECK_PTR_RET(src, 0);
+  CHECK_RET(dst != src, 0);
+  CHECK_RET(((itr == list_itr_end_t) ||
+             ((itr >= 0) && (itr < dst->size) && IS_USED(dst, itr))), 0);
+  CHECK_RET(((first >= 0) && (first < src->size) && IS_USED(src, first)), 0);
+
+  /* one reserve covers the most that can be moved */
+  if (n > src->count)
+    n = src->count;
+  CHECK_RET(list_reserve(dst, dst->count + n), 0);
+
+  for (i = 0; (i < n) && (first != list_itr_end_t); i++)
+  {
+    data = src->data[first];
+    next = LIST_ITR_NEXT(src, first);
+    pop_item(src, first);
+    push_item(dst, data, itr);
+    first = next;
+  }
+
+  return i;
+}
+
 void * list_get(list_t const * list, list_itr_t itr)
 {
   UNIT_TEST_RET(list_get);
@@ -356,9 +354,9 @@ void * list_get(list_t const * list, list_itr_t itr)
   CHECK_RET(itr != list_itr_end_t, NULL);
   CHECK_RET(list->size, NULL);                          /* empty list? */
   CHECK_RET(((itr >= 0) && (itr < list->size)), NULL);  /* valid index? */
-  CHECK_RET(ITEM_AT(list->items, itr)->used, NULL);   /* in used list? */
+  CHECK_RET(IS_USED(list, itr), NULL);                  /* in used list? */
 
-  return ITEM_AT(list->items, itr)->data;
+  return list->data[itr];
 }
 
 
@@ -366,70 +364,142 @@ void * list_get(list_t const * list, list_itr_t itr)
 
 /* removes the item at index "itr" and returns the iterator of the
  * item after the item that was removed. */
-static list_itr_t remove_item(list_item_t * items, list_itr_t itr)
+static list_itr_t remove_item(list_link_t * links, list_itr_t itr)
 {
   list_itr_t next = list_itr_end_t;
-  CHECK_PTR_RET(items, list_itr_end_t);
+  CHECK_PTR_RET(links, list_itr_end_t);
   CHECK_RET(itr != list_itr_end_t, list_itr_end_t);
 
   /* remove the item from the list if there is more than 1 item */
-  if ((ITEM_AT(items, itr)->next != itr) &&
-      (ITEM_AT(items, itr)->prev != itr))
+  if ((LINK_AT(links, itr)->next != itr) &&
+      (LINK_AT(links, itr)->prev != itr))
   {
-    next = ITEM_AT(items, itr)->next;
-    ITEM_AT(items, ITEM_AT(items, itr)->prev)->next = ITEM_AT(items, itr)->next;
-    ITEM_AT(items, ITEM_AT(items, itr)->next)->prev = ITEM_AT(items, itr)->prev;
+    next = LINK_AT(links, itr)->next;
+    LINK_AT(links, LINK_AT(links, itr)->prev)->next = LINK_AT(links, itr)->next;
+    LINK_AT(links, LINK_AT(links, itr)->next)->prev = LINK_AT(links, itr)->prev;
   }
 
   /* clear out the item's next/prev links */
-  ITEM_AT(items, itr)->next = list_itr_end_t;
-  ITEM_AT(items, itr)->prev = list_itr_end_t;
+  LINK_AT(links, itr)->next = list_itr_end_t;
+  LINK_AT(links, itr)->prev = list_itr_end_t;
 
   return next;
 }
 
 /* inserts the item at index "item" before the item at "itr" and returns
  * the iterator of the newly inserted item. */
-static list_itr_t insert_item(list_item_t * items, list_itr_t itr, list_itr_t item)
+static list_itr_t insert_item(list_link_t * links, list_itr_t itr, list_itr_t item)
 {
-  CHECK_PTR_RET(items, list_itr_end_t);
+  CHECK_PTR_RET(links, list_itr_end_t);
   CHECK_RET(item != list_itr_end_t, list_itr_end_t);
 
   /* if itr is list_itr_end_t, the list is empty, so make the
    * item the only node in the list */
   if (itr == list_itr_end_t)
   {
-    ITEM_AT(items, item)->prev = item;
-    ITEM_AT(items, item)->next = item;
+    LINK_AT(links, item)->prev = item;
+    LINK_AT(links, item)->next = item;
     return item;
   }
 
-  ITEM_AT(items, item)->next = itr;
-  ITEM_AT(items, ITEM_AT(items, itr)->prev)->next = item;
-  ITEM_AT(items, item)->prev = ITEM_AT(items, itr)->prev;
-  ITEM_AT(items, itr)->prev = item;
+  LINK_AT(links, item)->next = itr;
+  LINK_AT(links, LINK_AT(links, itr)->prev)->next = item;
+  LINK_AT(links, item)->prev = LINK_AT(links, itr)->prev;
+  LINK_AT(links, itr)->prev = item;
 
   return itr;
 }
 
+/* takes a node off the free list, stores data in it and links it into the
+ * used list before itr, or at the tail if itr is list_itr_end_t.  there must
+ * be a free node. */
+static void push_item(list_t * list, void * data, list_itr_t itr)
+{
+  list_itr_t item = list_itr_end_t;
+
+  /* get an item from the free list */
+  item = list->free_head;
+  list->free_head = remove_item(list->links, list->free_head);
+
+  /* store the data pointer over */
+  list->data[item] = data;
+  SET_USED(list, item);
+
+  /* if itr is list_itr_end_t, then we want to insert at the end of the list
+    * which is just before the head... but if the list is empty, we need to
+    * make sure that list_itr_end_t passes through */
+  if (list->count > 0)
+  {
+    if (itr == list_itr_end_t)
+    {
+      /* insert before the head but don't update the used_head, this puts
+        * the item at the tail of the list */
+      insert_item(list->links, list->used_head, item);
+    }
+    else
+    {
+      /* if we are inserting before the head, then update used_head so that
+        * the item is now the head of the list...otherwise, insert it into the
+        * list and don't update the used_head. */
+      insert_item(list->links, itr, item);
+      if (itr == list->used_head)
+        list->used_head = item;
+    }
+  }
+  else
+  {
+    /* insert into an empty list, update the used_head */
+    list->used_head = insert_item(list->links, itr, item);
+  }
+
+  /* update the count */
+  list->count++;
+}
+
+/* unlinks the used node at item and puts it on the free list.  returns the
+ * index of the item that followed it, which wraps around to the head if
+ * item was the tail, or list_itr_end_t if the list is now empty. */
+static list_itr_t pop_item(list_t * list, list_itr_t item)
+{
+  list_itr_t next = list_itr_end_t;
+
+  /* remove the item from the used list */
+  next = remove_item(list->links, item);
+
+  /* if we removed the head, update the used_head iterator */
+  if (item == list->used_head)
+    list->used_head = next;
+
+  /* reset the item and put it onto the free list */
+  list->data[item] = NULL;
+  CLR_USED(list, item);
+  list->free_head = insert_item(list->links, list->free_head, item);
+
+  /* update the count */
+  list->count--;
+
+  return next;
+}
+
+/* grows the node arrays by at least amount, doubling the size so that a
+ * run of pushes costs amortized O(1).  up to LIST_INLINE nodes live in the
+ * list struct, after that the arrays are on the heap.  either way the used
+ * and free rings keep their indices and the new nodes are just added to the
+ * free ring, which means iterators survive a grow. */
 static int_t list_grow(list_t * list, uint_t amount)
 {
   uint_t i = 0;
   uint_t new_size = 0;
-  list_item_t * items = NULL;
-  list_item_t * old = NULL;
-  list_itr_t itr = list_itr_end_t;
-  list_itr_t end = list_itr_end_t;
-  list_itr_t free_head = list_itr_end_t;
-  list_itr_t used_head = list_itr_end_t;
-  list_itr_t free_item = list_itr_end_t;
+  list_link_t * links = NULL;
+  void ** data = NULL;
+  uint64_t * used = NULL;
 
   CHECK_PTR_RET(list, FALSE);
   CHECK_RET(amount, TRUE); /* do nothing if grow amount is 0 */
 
   UNIT_TEST_RET(list_grow);
 
-  /* figure out how big the new item array should be */
+  /* figure out how big the new node arrays should be */
   if (list->size)
   {
     new_size = list->size;
@@ -443,41 +513,67 @@ static int_t list_grow(list_t * list, uint_t amount)
   else
     new_size = amount;
 
-  /* try to allocate a new item array */
-  items = CALLOC(new_size, sizeof(list_item_t));
-  CHECK_PTR_RET(items, FALSE);
+  CHECK_RET(new_size <= LIST_MAX_SIZE, FALSE);
 
-  /* initialize the new array as a free list */
-  for (i = 0; i < new_size; i++)
+  if (new_size <= LIST_INLINE)
   {
-    free_head = insert_item(items, free_head, i);
+    /* small lists keep their nodes in the struct */
+    links = list->inline_links;
+    data = list->inline_data;
+    used = &(list->inline_used);
   }
+  else if ((list->links == NULL) || IS_INLINE(list))
+  {
+    /* spill to the heap, copying any inline nodes over */
+    links = CALLOC(new_size, sizeof(list_link_t));
+    data = CALLOC(new_size, sizeof(void*));
+    used = CALLOC(USED_WORDS(new_size), sizeof(uint64_t));
+    if ((links == NULL) || (data == NULL) || (used == NULL))
+    {
+      FREE(links);
+      FREE(data);
+      FREE(used);
+      return FALSE;
+    }
 
-  /* move items from old array to new array */
-  end = list_itr_end(list);
-  for (itr = list_itr_begin(list); itr != end; itr = list_itr_next(list, itr))
+    if (list->size)
+    {
+      MEMCPY(links, list->links, list->size * sizeof(list_link_t));
+      MEMCPY(data, list->data, list->size * sizeof(void*));
+      MEMCPY(used, list->used, USED_WORDS(list->size) * sizeof(uint64_t));
+    }
+  }
+  else
   {
-    /* get an item from the free list */
-    free_item = free_head;
-    free_head = remove_item(items, free_head);
+    /* resize each array.  the list only uses the first size nodes of them
+     * so it is still intact if a later one fails */
+    links = REALLOC(list->links, new_size * sizeof(list_link_t));
+    CHECK_PTR_RET(links, FALSE);
+    list->links = links;
+
+    data = REALLOC(list->data, new_size * sizeof(void*));
+    CHECK_PTR_RET(data, FALSE);
+    list->data = data;
+
+    used = REALLOC(list->used, USED_WORDS(new_size) * sizeof(uint64_t));
+    CHECK_PTR_RET(used, FALSE);
+  }
+
+  list->links = links;
+  list->data = data;
+  list->used = used;
 
-    /* copy the data pointer over */
-    ITEM_AT(items, free_item)->data = ITEM_AT(list->items, itr)->data;
-    ITEM_AT(items, free_item)->used = ITEM_AT(list->items, itr)->used;
+  MEMSET(&(data[list->size]), 0, (new_size - list->size) * sizeof(void*));
+  MEMSET(&(used[USED_WORDS(list->size)]), 0,
+         (USED_WORDS(new_size) - USED_WORDS(list->size)) * sizeof(uint64_t));
 
-    /* insert the item into the data list */
-    used_head = insert_item(items, used_head, free_item);
+  /* add the new nodes to the free list */
+  for (i = list->size; i < new_size; i++)
+  {
+    list->free_head = insert_item(links, list->free_head, i);
   }
 
-  /* if we get here, we can update the list struct */
-  old = list->items;
-  list->items = items;
   list->size = new_size;
-  list->used_head = used_head;
-  list->free_head = free_head;
-
-  /* free up the old items array */
-  FREE(old);
 
   return TRUE;
 }
@@ -489,27 +585,27 @@ static int_t list_grow(list_t * list, uint_t amount)
 void test_list_private_functions(void)
 {
   int_t i;
-  list_item_t items[4];
+  list_link_t links[4];
   list_itr_t head = list_itr_end_t;
-  MEMSET(items, 0, 4 * sizeof(list_item_t));
+  MEMSET(links, 0, 4 * sizeof(list_link_t));
 
   /* REMOVE_ITEM TESTS */
 
   /* test remove_item pre-reqs */
   CU_ASSERT_EQUAL(remove_item(NULL, list_itr_end_t), list_itr_end_t);
-  CU_ASSERT_EQUAL(remove_item(items, list_itr_end_t), list_itr_end_t);
+  CU_ASSERT_EQUAL(remove_item(links, list_itr_end_t), list_itr_end_t);
 
   /* add some items */
   for(i = 0; i < 4; i++)
   {
-    head = insert_item(items, head, i);
+    head = insert_item(links, head, i);
   }
 
   /* remove items from the back */
-  CU_ASSERT_EQUAL(remove_item(items, 3), 0);
-  CU_ASSERT_EQUAL(remove_item(items, 2), 0);
-  CU_ASSERT_EQUAL(remove_item(items, 1), 0);
-  CU_ASSERT_EQUAL(remove_item(items, 0), list_itr_end_t);
+  CU_ASSERT_EQUAL(remove_item(links, 3), 0);
+  CU_ASSERT_EQUAL(remove_item(links, 2), 0);
+  CU_ASSERT_EQUAL(remove_item(links, 1), 0);
+  CU_ASSERT_EQUAL(remove_item(links, 0), list_itr_end_t);
 
   /* reset head itr */
   head = list_itr_end_t;
@@ -517,20 +613,20 @@ void test_list_private_functions(void)
   /* add some items */
   for(i = 0; i < 4; i++)
   {
-    head = insert_item(items, head, i);
+    head = insert_item(links, head, i);
   }
 
   /* remove items from the front */
-  CU_ASSERT_EQUAL(remove_item(items, 0), 1);
-  CU_ASSERT_EQUAL(remove_item(items, 1), 2);
-  CU_ASSERT_EQUAL(remove_item(items, 2), 3);
-  CU_ASSERT_EQUAL(remove_item(items, 3), list_itr_end_t);
+  CU_ASSERT_EQUAL(remove_item(links, 0), 1);
+  CU_ASSERT_EQUAL(remove_item(links, 1), 2);
+  CU_ASSERT_EQUAL(remove_item(links, 2), 3);
+  CU_ASSERT_EQUAL(remove_item(links, 3), list_itr_end_t);
 
   /* INSERT_ITEM TESTS */
 
   /* test insert_item pre-reqs */
   CU_ASSERT_EQUAL(insert_item(NULL, list_itr_end_t, list_itr_end_t), list_itr_end_t);
-  CU_ASSERT_EQUAL(insert_item(items, list_itr_end_t, list_itr_end_t), list_itr_end_t);
+  CU_ASSERT_EQUAL(insert_item(links, list_itr_end_t, list_itr_end_t), list_itr_end_t);
 
   /* LIST_GROW TESTS */
   CU_ASSERT_FALSE(list_grow(NULL, 0));
@@ -35,8 +35,18 @@ typedef void (*list_delete_fn)(void*);
 /* defines the list iterator type */
 typedef int_t list_itr_t;
 
-/* internal node struct */
-typedef struct list_item_s list_item_t;
+/* the links of a node.  they live in their own array, apart from the data
+ * pointers and used flags, so walking a list only touches 8 bytes a node */
+typedef struct list_link_s
+{
+  int32_t         next;           /* next node in the list */
+  int32_t         prev;           /* prev node in the list */
+} list_link_t;
+
+/* the number of nodes kept inside the list struct.  a list only allocates
+ * its node arrays once it needs more than this, so a list_t must not be
+ * copied or moved while it is initialized. */
+#define LIST_INLINE (4)
 
 /* dynamic list struct */
 typedef struct list_s
@@ -46,7 +56,12 @@ typedef struct list_s
   uint_t          count;          /* number of items in the list */
   list_itr_t      used_head;      /* head node of the used circular list */
   list_itr_t      free_head;      /* head node of the free circular list */
-  list_item_t*    items;          /* array of list items */
+  list_link_t*    links;          /* array of node links */
+  void**          data;           /* array of node data pointers */
+  uint64_t*       used;           /* bitmap of nodes in the used list */
+  list_link_t     inline_links[LIST_INLINE];  /* links of the inline nodes */
+  void*           inline_data[LIST_INLINE];   /* data of the inline nodes */
+  uint64_t        inline_used;                /* used bitmap of the inline nodes */
 } list_t;
 
 /* heap allocated list */
@@ -85,14 +100,46 @@ int_t list_push(list_t * list, void * data, list_itr_t itr);
 #define list_push_head(list, data) list_push(list, data, list_itr_head(list))
 #define list_push_tail(list, data) list_push(list, data, list_itr_end(list))
 
+/* pushes n items before itr, in order, growing the list at most once */
+int_t list_push_many(list_t * list, void * const * data, uint_t n, list_itr_t itr);
+#define list_push_many_head(list, data, n) list_push_many(list, data, n, list_itr_head(list))
+#define list_push_many_tail(list, data, n) list_push_many(list, data, n, list_itr_end(list))
+
 /* O(1) functions for removing items from the list */
 list_itr_t list_pop(list_t * list, list_itr_t itr);
 #define list_pop_head(list) list_pop(list, list_itr_head(list))
 #define list_pop_tail(list) list_pop(list, list_itr_end(list))
 
+/* pops up to n items starting at itr and moving toward the tail, storing
+ * their data pointers in data.  returns the number popped. */
+uint_t list_pop_many(list_t * list, list_itr_t itr, void ** data, uint_t n);
+#define list_pop_many_head(list, data, n) list_pop_many(list, list_itr_head(list), data, n)
+
+/* moves up to n items, starting at first in src and moving toward its tail,
+ * to dst before itr (or at its tail if itr is list_itr_end_t).  dst is
+ * grown at most once.  returns the number moved. */
+uint_t list_splice(list_t * dst, list_itr_t itr, list_t * src,
+                   list_itr_t first, uint_t n);
+
 /* functions for getting the data pointer from the list */
 void* list_get(list_t const * list, list_itr_t itr);
 #define list_get_head(list) list_get(list, list_itr_head(list))
 #define list_get_tail(list) list_get(list, list_itr_tail(list))
 
+/* unchecked iteration.  these do no argument checking so list must be
+ * valid and itr must be an item in it.  the item at itr must not be popped
+ * inside a LIST_FOREACH loop. */
+#define LIST_ITR_END (-1)
+#define LIST_ITR_NEXT(list, itr) \
+  (((list)->links[(itr)].next != (list)->used_head) ? (list)->links[(itr)].next : LIST_ITR_END)
+#define LIST_ITR_RNEXT(list, itr) \
+  (((itr) != (list)->used_head) ? (list)->links[(itr)].prev : LIST_ITR_END)
+#define LIST_GET(list, itr) ((list)->data[(itr)])
+#define LIST_FOREACH(list, itr) \
+  for ((itr) = ((list)->count ? (list)->used_head : LIST_ITR_END); \
+       (itr) != LIST_ITR_END; (itr) = LIST_ITR_NEXT(list, itr))
+#define LIST_RFOREACH(list, itr) \
+  for ((itr) = ((list)->count ? (list)->links[(list)->used_head].prev : LIST_ITR_END); \
+       (itr) != LIST_ITR_END; (itr) = LIST_ITR_RNEXT(list, itr))
+
 #endif /*LIST_H*/
@@ -144,10 +144,14 @@ extern int_t fail_alloc;
 #define MEMSET memset
 #define MEMCMP memcmp
 #define MEMCPY memcpy
+#define MEMMOVE memmove
 
 extern int_t fake_accept;
 extern int fake_accept_ret;
 #define ACCEPT(...) (fake_accept ? fake_accept_ret : accept(__VA_ARGS__))
+extern int_t fake_accept4;
+extern int fake_accept4_ret;
+#define ACCEPT4(...) (fake_accept4 ? fake_accept4_ret : accept4(__VA_ARGS__))
 
 extern int_t fake_bind;
 extern int fake_bind_ret;
@@ -245,6 +249,10 @@ extern int_t fake_recvmsg;
 extern ssize_t fake_recvmsg_ret;
 #define RECVMSG(...) (fake_recvmsg ? fake_recvmsg_ret : recvmsg(__VA_ARGS__))
 
+extern int_t fake_recvmmsg;
+extern int fake_recvmmsg_ret;
+#define RECVMMSG(...) (fake_recvmmsg ? fake_recvmmsg_ret : recvmmsg(__VA_ARGS__))
+
 extern int_t fake_send;
 extern ssize_t fake_send_ret;
 #define SEND(...) (fake_send ? fake_send_ret : send(__VA_ARGS__))
@@ -253,6 +261,10 @@ extern int_t fake_sendmsg;
 extern ssize_t fake_sendmsg_ret;
 #define SENDMSG(...) (fake_sendmsg ? fake_sendmsg_ret : sendmsg(__VA_ARGS__))
 
+extern int_t fake_sendmmsg;
+extern int fake_sendmmsg_ret;
+#define SENDMMSG(...) (fake_sendmmsg ? fake_sendmmsg_ret : sendmmsg(__VA_ARGS__))
+
 extern int_t fake_sendto;
 extern ssize_t fake_sendto_ret;
 #define SENDTO(...) (fake_sendto ? fake_sendto_ret : sendto(__VA_ARGS__))
@@ -331,6 +343,10 @@ extern void* fake_ev_default_loop_ret;
 #define ACCEPT accept
 #endif
 
+#if !defined(ACCEPT4)
+#define ACCEPT4 accept4
+#endif
+
 #if !defined(BIND)
 #define BIND bind
 #endif
@@ -423,6 +439,10 @@ extern void* fake_ev_default_loop_ret;
 #define MEMCPY memcpy
 #endif
 
+#if !defined(MEMMOVE)
+#define MEMMOVE memmove
+#endif
+
 #if !defined(MEMSET)
 #define MEMSET memset
 #endif
@@ -455,6 +475,10 @@ extern void* fake_ev_default_loop_ret;
 #define RECVMSG recvmsg
 #endif
 
+#if !defined(RECVMMSG)
+#define RECVMMSG recvmmsg
+#endif
+
 #if !defined(SEND)
 #define SEND send
 #endif
@@ -463,6 +487,10 @@ extern void* fake_ev_default_loop_ret;
 #define SENDMSG sendmsg
 #endif
 
+#if !defined(SENDMMSG)
+#define SENDMMSG sendmmsg
+#endif
+
 #if !defined(SENDTO)
 #define SENDTO sendto
 #endif
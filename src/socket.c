@@ -23,6 +23,8 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+/* for accept4 */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -33,6 +35,7 @@
 #include <errno.h>
 #include <netdb.h>
 #include <poll.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/ioctl.h>
@@ -57,11 +60,16 @@ extern evt_loop_t * el;
 
 typedef struct addrinfo addrinfo_t;
 
-typedef struct write_dst_s
+/* max number of free write destinations kept around for reuse */
+#define S_DST_POOL_MAX (64)
+
+typedef struct write_dst_s write_dst_t;
+struct write_dst_s
 {
   sockaddr_t        addr;
   socklen_t         addrlen;
-} write_dst_t;
+  write_dst_t      *next;         /* next dst in the free pool */
+};
 
 struct socket_s
 {
@@ -79,9 +87,23 @@ struct socket_s
   sockaddr_t     *readaddr;       /* place to put addr for UDP read */
   socklen_t      *readaddrlen;    /* place to put addr len for UDP read */
   cb_t           *cb;             /* callbacks manager */
-  cb_t           *int_cb;         /* internal callback manager */
   aiofd_t        *aiofd;          /* the async fd */
   evt_loop_t     *el;             /* the event loop for this socket */
+  write_dst_t    *pool;           /* free write destinations */
+  size_t          npool;          /* number of dsts in the pool */
+  size_t          hits;           /* writes that reused a pooled dst */
+  size_t          misses;         /* writes that had to allocate a dst */
+  int_t           accepted;       /* fd came from accept4, already non-blocking */
+  int             accept_max;     /* connections to accept per read event */
+  cb_t           *accept_cb;      /* callbacks for batch accepted sockets */
+  int_t           reuseport;      /* set SO_REUSEPORT before binding */
+};
+
+struct socket_shards_s
+{
+  int             n;              /* number of shards */
+  evt_thread_t  **threads;        /* one loop and thread per shard */
+  socket_t      **socks;          /* one listener per shard */
 };
 
 uint8_t const * const socket_cb[S_CB_COUNT] =
@@ -93,45 +115,58 @@ uint8_t const * const socket_cb[S_CB_COUNT] =
   UT("socket-write-evt")
 };
 
+/* callback ids, resolved from socket_cb once per process */
+static cb_id_t socket_cb_ids[S_CB_COUNT];
+static int_t socket_cb_ok = FALSE;
+static pthread_once_t socket_cb_once = PTHREAD_ONCE_INIT;
+#define S_CB_ID(x) (socket_cb_ids[x])
+
 /* helper macros for calling callbacks */
-#define S_CONN_EVT(cb, ...) cb_call(cb, S_CB_NAME(S_CONN_EVT), __VA_ARGS__)
-#define S_DISC_EVT(cb, ...) cb_call(cb, S_CB_NAME(S_DISC_EVT), __VA_ARGS__)
-#define S_ERR_EVT(cb, ...) cb_call(cb, S_CB_NAME(S_ERR_EVT), __VA_ARGS__)
-#define S_READ_EVT(cb, ...) cb_call(cb, S_CB_NAME(S_READ_EVT), __VA_ARGS__)
-#define S_WRITE_EVT(cb, ...) cb_call(cb, S_CB_NAME(S_WRITE_EVT), __VA_ARGS__)
+#define S_CONN_EVT(cb, ...) cb_call_id(cb, S_CB_ID(S_CONN_EVT), __VA_ARGS__)
+#define S_DISC_EVT(cb, ...) cb_call_id(cb, S_CB_ID(S_DISC_EVT), __VA_ARGS__)
+#define S_ERR_EVT(cb, ...) cb_call_id(cb, S_CB_ID(S_ERR_EVT), __VA_ARGS__)
+#define S_READ_EVT(cb, ...) cb_call_id(cb, S_CB_ID(S_READ_EVT), __VA_ARGS__)
+#define S_WRITE_EVT(cb, ...) cb_call_id(cb, S_CB_ID(S_WRITE_EVT), __VA_ARGS__)
 
 /*
  * SOCKET EVENT CALLBACKS
  */
 
-static void s_read_evt(socket_t *s, aiofd_t *a, size_t n);
-static void s_write_evt(socket_t *s, write_dst_t *wd, aiofd_t *a, void *buf,
+static void s_read_evt(void *ctx, aiofd_t *a, size_t n);
+static void s_write_evt(void *ctx, void *wdata, aiofd_t *a, void *buf,
                         size_t n);
-static void s_error_evt(socket_t *s, write_dst_t *wd, aiofd_t *a, int eno);
-static void s_read_io(socket_t *s, aiofd_t *a, int fd, void *buf, size_t n,
+static void s_error_evt(void *ctx, void *wdata, aiofd_t *a, int eno);
+static void s_read_io(void *ctx, aiofd_t *a, int fd, void *buf, size_t n,
                       ssize_t *r);
-static void s_write_io(socket_t *s, write_dst_t *wd, aiofd_t *a, int fd,
+static void s_write_io(void *ctx, void *wdata, aiofd_t *a, int fd,
                        void const *buf, size_t n, ssize_t *r);
-static void s_readv_io(socket_t *s, aiofd_t *a, int fd, struct iovec *iov,
+static void s_readv_io(void *ctx, aiofd_t *a, int fd, struct iovec *iov,
                        size_t n, ssize_t *r);
-static void s_writev_io(socket_t *s, write_dst_t *wd, aiofd_t *a, int fd,
+static void s_writev_io(void *ctx, void *wdata, aiofd_t *a, int fd,
                         struct iovec const *iov, size_t n, ssize_t *r);
-static void s_nread_io(socket_t *s, aiofd_t *a, int fd, size_t *n, int_t *l,
+static void s_nread_io(void *ctx, aiofd_t *a, int fd, size_t *n, int_t *l,
                        int *r);
+static void s_writem_io(void *ctx, aiofd_t *a, int fd, aiofd_msg_t const *msgs,
+                        size_t n, ssize_t *r);
 
-/* declare the callbacks */
-READ_EVT_CB(s_read_evt, socket_t*);
-WRITE_EVT_CB(s_write_evt, socket_t*, write_dst_t*);
-ERROR_EVT_CB(s_error_evt, socket_t*, write_dst_t*);
-READ_IO_CB(s_read_io, socket_t*);
-WRITE_IO_CB(s_write_io, socket_t*, write_dst_t*);
-READV_IO_CB(s_readv_io, socket_t*);
-WRITEV_IO_CB(s_writev_io, socket_t*, write_dst_t*);
-NREAD_IO_CB(s_nread_io, socket_t*);
+/* the aiofd calls these directly, no callback manager involved */
+static aiofd_ops_t const s_aiofd_ops =
+{
+  &s_read_evt,
+  &s_write_evt,
+  &s_error_evt,
+  &s_read_io,
+  &s_write_io,
+  &s_readv_io,
+  &s_writev_io,
+  &s_nread_io,
+  &s_writem_io
+};
 
 /*
  * HELPER FUNCTIONS
  */
+static void s_resolve_cb_ids(void);
 static int_t s_init(socket_t *s, socket_type_t t, cb_t *cb,
                     uint8_t const *host, uint8_t const *port,
                     int ai_flags, int ai_family);
@@ -149,6 +184,9 @@ static inline void * s_in_addr(sockaddr_t const *addr);
 static inline in_port_t s_in_port(sockaddr_t const *addr);
 static inline int_t s_validate_port(uint8_t const *port);
 static int_t s_get_error(socket_t *s, int *errval);
+static write_dst_t * s_get_dst(socket_t *s);
+static void s_put_dst(socket_t *s, write_dst_t *wd);
+static void s_accept_batch(socket_t *s);
 
 
 socket_t * socket_new(socket_type_t t, cb_t *cb,
@@ -250,6 +288,15 @@ socket_ret_t socket_bind(socket_t *s)
     r = SETSOCKOPT(s->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
     CHECK_GOTO(r == 0, _bind_fail_1);
     DEBUG("turned on IP socket address reuse\n");
+
+#if defined(SO_REUSEPORT)
+    if(s->reuseport)
+    {
+      r = SETSOCKOPT(s->fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+      CHECK_GOTO(r == 0, _bind_fail_1);
+      DEBUG("turned on IP socket port reuse\n");
+    }
+#endif
   }
 
   /* bind the socket */
@@ -294,12 +341,19 @@ socket_ret_t socket_listen(socket_t * s, int backlog, evt_loop_t *el)
 
   /* flag the socket as listening */
   s->listening = TRUE;
+  aiofd_set_listen(s->aiofd, TRUE);
+
+  /* store the event loop for the accepted sockets */
+  s->el = el;
 
   return SOCKET_OK;
 }
 
 socket_t * socket_accept(socket_t *s, cb_t *cb, evt_loop_t *el)
 {
+  int fd = -1;
+  sockaddr_t addr;
+  socklen_t addrlen = sizeof(addr);
   socket_t *c;
 
   CHECK_PTR_RET(s, NULL);
@@ -310,17 +364,30 @@ socket_t * socket_accept(socket_t *s, cb_t *cb, evt_loop_t *el)
   /* don't call accept on UDP sockets */
   CHECK_RET(s->type != SOCKET_UDP, NULL);
 
+  /* accept the incoming connection before allocating anything for it, an
+   * empty backlog costs just the accept call */
+#if defined(SOCK_NONBLOCK)
+  /* saves the fcntl calls in s_open */
+  fd = ACCEPT4(s->fd, (struct sockaddr *)&addr, &addrlen,
+               SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  fd = ACCEPT(s->fd, (struct sockaddr *)&addr, &addrlen);
+#endif
+  CHECK_RET(fd >= 0, NULL);
+
   /* create a new socket for the incoming connection */
   c = CALLOC(1, sizeof(socket_t));
-  CHECK_PTR_RET_MSG(c, NULL, "failed to allocate new socket struct\n");
+  CHECK_PTR_GOTO(c, _accept_fail_0);
 
   /* initlialize the socket */
   CHECK_GOTO(s_init(c, s->type, cb, NULL, NULL, 0, 0), _accept_fail_1);
 
-  /* accept the incoming connection */
-  c->addrlen = sizeof(c->addr);
-  c->fd = ACCEPT(s->fd, (struct sockaddr *)&(c->addr), &(c->addrlen));
-  CHECK_GOTO(c->fd >= 0, _accept_fail_2);
+  c->fd = fd;
+  c->addr = addr;
+  c->addrlen = addrlen;
+#if defined(SOCK_NONBLOCK)
+  c->accepted = TRUE;
+#endif
 
   /* initialize the connection info */
   switch(s->type)
@@ -328,17 +395,8 @@ socket_t * socket_accept(socket_t *s, cb_t *cb, evt_loop_t *el)
     case SOCKET_UDP:
       break;
     case SOCKET_TCP:
-      /* fill in the host string */
-      FREE(c->host);
-      c->host = CALLOC(HOST_BUF_LEN, sizeof(uint8_t));
-      CHECK_PTR_GOTO(c->host, _accept_fail_2);
-      CHECK_GOTO(socket_addr_str(&(c->addr), c->host, HOST_BUF_LEN), _accept_fail_2);
-
-      /* fill in the port string */
-      FREE(c->port);
-      c->port = CALLOC(PORT_BUF_LEN, sizeof(uint8_t));
-      CHECK_PTR_GOTO(c->port, _accept_fail_2);
-      CHECK_GOTO(socket_port_str(&(c->addr), c->port, PORT_BUF_LEN), _accept_fail_2);
+      /* the host and port strings are only formatted if they are asked for,
+       * see socket_get_host() and socket_get_port() */
       break;
 
     case SOCKET_UNIX:
@@ -356,18 +414,98 @@ socket_t * socket_accept(socket_t *s, cb_t *cb, evt_loop_t *el)
 
   /* we're connected so start read event */
   CHECK_GOTO(aiofd_enable_read_evt(c->aiofd, TRUE, el), _accept_fail_2);
+  c->el = el;
 
   return c;
 
 _accept_fail_2:
+  /* s_deinit only closes the fd once s_open has wrapped it in an aiofd */
+  if(c->aiofd == NULL)
+  {
+    CLOSE(c->fd);
+    c->fd = -1;
+  }
   s_deinit(c);
+  FREE(c);
+  return NULL;
 _accept_fail_1:
+  FREE(c);
+_accept_fail_0:
   DEBUG("socket_accept failure: %s\n", check_err_str_);
   DEBUG("ERRNO is: %d -- %s\n", ERRNO, strerror(ERRNO));
-  FREE(c);
+  CLOSE(fd);
   return NULL;
 }
 
+int_t socket_set_reuseport(socket_t *s, int_t reuse)
+{
+  CHECK_PTR_RET(s, FALSE);
+  CHECK_RET(!socket_is_bound(s), FALSE);
+  CHECK_RET((s->type == SOCKET_UDP) || (s->type == SOCKET_TCP), FALSE);
+#if !defined(SO_REUSEPORT)
+  CHECK_RET(!reuse, FALSE);
+#endif
+  s->reuseport = reuse;
+  return TRUE;
+}
+
+evt_loop_t * socket_get_loop(socket_t const *s)
+{
+  CHECK_PTR_RET(s, NULL);
+  return s->el;
+}
+
+uint8_t const * socket_get_host(socket_t *s)
+{
+  CHECK_PTR_RET(s, NULL);
+
+  /* format the peer address of an accepted socket on first use */
+  if((s->host == NULL) && (s->type == SOCKET_TCP) && (s->addrlen > 0))
+  {
+    s->host = CALLOC(INET6_ADDRSTRLEN, sizeof(uint8_t));
+    CHECK_PTR_RET(s->host, NULL);
+    if(!socket_addr_str(&(s->addr), s->host, INET6_ADDRSTRLEN))
+    {
+      FREE(s->host);
+      s->host = NULL;
+    }
+  }
+
+  return s->host;
+}
+
+uint8_t const * socket_get_port(socket_t *s)
+{
+  CHECK_PTR_RET(s, NULL);
+
+  /* format the peer port of an accepted socket on first use */
+  if((s->port == NULL) && (s->type == SOCKET_TCP) && (s->addrlen > 0))
+  {
+    s->port = CALLOC(PORT_BUF_LEN, sizeof(uint8_t));
+    CHECK_PTR_RET(s->port, NULL);
+    if(!socket_port_str(&(s->addr), s->port, PORT_BUF_LEN))
+    {
+      FREE(s->port);
+      s->port = NULL;
+    }
+  }
+
+  return s->port;
+}
+
+socket_ret_t socket_set_accept_batch(socket_t *s, int max, cb_t *cb)
+{
+  CHECK_PTR_RET(s, SOCKET_BADPARAM);
+  CHECK_RET(max >= 0, SOCKET_BADPARAM);
+
+  /* UDP sockets don't accept */
+  CHECK_RET(s->type != SOCKET_UDP, SOCKET_ERROR);
+
+  s->accept_max = max;
+  s->accept_cb = cb;
+  return SOCKET_OK;
+}
+
 int_t socket_addr_str(sockaddr_t const *addr, uint8_t *buf, size_t n)
 {
   CHECK_PTR_RET(addr, FALSE);
@@ -504,6 +642,127 @@ ssize_t socket_readv_from(socket_t * s,
     return aiofd_readv(s->aiofd, iov, iovcnt);
 }
 
+ssize_t socket_read_many(socket_t *s, socket_msg_t *msgs, size_t n)
+{
+  size_t i;
+  ssize_t ret = 0;
+#if defined(__linux__)
+  struct mmsghdr mm[SOCKET_MSG_MAX];
+#else
+  ssize_t r = 0;
+  struct msghdr m;
+#endif
+
+  CHECK_PTR_RET(s, -1);
+  CHECK_PTR_RET(msgs, -1);
+  CHECK_RET(n > 0, -1);
+  CHECK_RET(s->type == SOCKET_UDP, -1);
+
+  if(n > SOCKET_MSG_MAX)
+    n = SOCKET_MSG_MAX;
+
+#if defined(__linux__)
+  MEMSET(mm, 0, n * sizeof(struct mmsghdr));
+  for(i = 0; i < n; i++)
+  {
+    mm[i].msg_hdr.msg_iov = msgs[i].iov;
+    mm[i].msg_hdr.msg_iovlen = msgs[i].iovcnt;
+    mm[i].msg_hdr.msg_name = (void*)&(msgs[i].addr);
+    mm[i].msg_hdr.msg_namelen = sizeof(sockaddr_t);
+  }
+
+  /* receive them all at once */
+  ret = RECVMMSG(s->fd, mm, n, 0, NULL);
+  CHECK_RET(ret >= 0, -1);
+
+  for(i = 0; i < (size_t)ret; i++)
+  {
+    msgs[i].len = mm[i].msg_len;
+    msgs[i].addrlen = mm[i].msg_hdr.msg_namelen;
+  }
+#else
+  /* no recvmmsg, so one at a time until we run out */
+  for(i = 0; i < n; i++)
+  {
+    MEMSET(&m, 0, sizeof(struct msghdr));
+    m.msg_iov = msgs[i].iov;
+    m.msg_iovlen = msgs[i].iovcnt;
+    m.msg_name = (void*)&(msgs[i].addr);
+    m.msg_namelen = sizeof(sockaddr_t);
+
+    r = RECVMSG(s->fd, &m, 0);
+    if(r < 0)
+      break;
+
+    msgs[i].len = (size_t)r;
+    msgs[i].addrlen = m.msg_namelen;
+    ret++;
+  }
+  CHECK_RET((ret > 0) || (r >= 0), -1);
+#endif
+
+  return ret;
+}
+
+ssize_t socket_write_many(socket_t *s, socket_msg_t const *msgs, size_t n)
+{
+  size_t i;
+  ssize_t ret = 0;
+#if defined(__linux__)
+  struct mmsghdr mm[SOCKET_MSG_MAX];
+#else
+  ssize_t r = 0;
+  struct msghdr m;
+#endif
+
+  CHECK_PTR_RET(s, -1);
+  CHECK_PTR_RET(msgs, -1);
+  CHECK_RET(n > 0, -1);
+  CHECK_RET(s->type == SOCKET_UDP, -1);
+
+  if(n > SOCKET_MSG_MAX)
+    n = SOCKET_MSG_MAX;
+
+#if defined(__linux__)
+  MEMSET(mm, 0, n * sizeof(struct mmsghdr));
+  for(i = 0; i < n; i++)
+  {
+    mm[i].msg_hdr.msg_iov = msgs[i].iov;
+    mm[i].msg_hdr.msg_iovlen = msgs[i].iovcnt;
+    if(!socket_is_connected(s))
+    {
+      mm[i].msg_hdr.msg_name = (void*)&(msgs[i].addr);
+      mm[i].msg_hdr.msg_namelen = msgs[i].addrlen;
+    }
+  }
+
+  /* send them all at once */
+  ret = SENDMMSG(s->fd, mm, n, 0);
+  CHECK_RET(ret >= 0, -1);
+#else
+  /* no sendmmsg, so one at a time until the socket is full */
+  for(i = 0; i < n; i++)
+  {
+    MEMSET(&m, 0, sizeof(struct msghdr));
+    m.msg_iov = msgs[i].iov;
+    m.msg_iovlen = msgs[i].iovcnt;
+    if(!socket_is_connected(s))
+    {
+      m.msg_name = (void*)&(msgs[i].addr);
+      m.msg_namelen = msgs[i].addrlen;
+    }
+
+    r = SENDMSG(s->fd, &m, 0);
+    if(r < 0)
+      break;
+    ret++;
+  }
+  CHECK_RET((ret > 0) || (r >= 0), -1);
+#endif
+
+  return ret;
+}
+
 socket_ret_t socket_write(socket_t * s,
                            uint8_t const * buffer,
                            size_t n)
@@ -540,7 +799,7 @@ socket_ret_t socket_write_to(socket_t * s,
     CHECK_PTR_RET(s, SOCKET_BADPARAM);
 
     /* we'll get the pointer to this memory back in the write callback */
-    wd = CALLOC(1, sizeof(write_dst_t));
+    wd = s_get_dst(s);
     if (wd == NULL)
     {
         DEBUG("failed to calloc write destination struct\n");
@@ -551,7 +810,12 @@ socket_ret_t socket_write_to(socket_t * s,
     MEMCPY(&(wd->addr), addr, sizeof(sockaddr_t));
     wd->addrlen = addrlen;
 
-    return (aiofd_write(s->aiofd, buffer, n, (void*)wd) ? SOCKET_OK : SOCKET_ERROR);
+    if (!aiofd_write(s->aiofd, buffer, n, (void*)wd))
+    {
+        s_put_dst(s, wd);
+        return SOCKET_ERROR;
+    }
+    return SOCKET_OK;
 }
 
 socket_ret_t socket_writev_to(socket_t * s,
@@ -564,7 +828,7 @@ socket_ret_t socket_writev_to(socket_t * s,
     CHECK_PTR_RET(s, SOCKET_BADPARAM);
 
     /* we'll get the pointer to this memory back in the write callback */
-    wd = CALLOC(1, sizeof(write_dst_t));
+    wd = s_get_dst(s);
     if (wd == NULL)
     {
         DEBUG("failed to calloc write destination struct\n");
@@ -575,7 +839,140 @@ socket_ret_t socket_writev_to(socket_t * s,
     MEMCPY(&(wd->addr), addr, sizeof(sockaddr_t));
     wd->addrlen = addrlen;
 
-    return (aiofd_writev(s->aiofd, iov, iovcnt, (void*)wd) ? SOCKET_OK : SOCKET_ERROR);
+    if (!aiofd_writev(s->aiofd, iov, iovcnt, (void*)wd))
+    {
+        s_put_dst(s, wd);
+        return SOCKET_ERROR;
+    }
+    return SOCKET_OK;
+}
+
+/*
+ * LISTENER SHARDS
+ */
+
+socket_shards_t * socket_shards_new(int n, cb_t *cb,
+                                    uint8_t const *host, uint8_t const *port,
+                                    int ai_flags, int ai_family)
+{
+  int i;
+  socket_shards_t *sh = NULL;
+
+  CHECK_RET(n > 0, NULL);
+
+  sh = CALLOC(1, sizeof(socket_shards_t));
+  CHECK_PTR_RET(sh, NULL);
+
+  sh->threads = CALLOC(n, sizeof(evt_thread_t*));
+  CHECK_PTR_GOTO(sh->threads, _shards_new_1);
+  sh->socks = CALLOC(n, sizeof(socket_t*));
+  CHECK_PTR_GOTO(sh->socks, _shards_new_1);
+  sh->n = n;
+
+  for(i = 0; i < n; i++)
+  {
+    sh->threads[i] = evt_thread_new();
+    CHECK_PTR_GOTO(sh->threads[i], _shards_new_1);
+
+    /* every shard binds its own listener to the same address */
+    sh->socks[i] = socket_new(SOCKET_TCP, cb, host, port, ai_flags, ai_family);
+    CHECK_PTR_GOTO(sh->socks[i], _shards_new_1);
+    CHECK_GOTO(socket_set_reuseport(sh->socks[i], TRUE), _shards_new_1);
+    CHECK_GOTO(socket_bind(sh->socks[i]) == SOCKET_OK, _shards_new_1);
+  }
+
+  return sh;
+
+_shards_new_1:
+  DEBUG("socket_shards_new failure: %s\n", check_err_str_);
+  socket_shards_delete(sh);
+  return NULL;
+}
+
+void socket_shards_delete(void *p)
+{
+  int i;
+  socket_shards_t *sh = (socket_shards_t*)p;
+  CHECK_PTR(sh);
+
+  /* the loops must be stopped before their sockets go away */
+  socket_shards_stop(sh);
+
+  for(i = 0; i < sh->n; i++)
+  {
+    if(sh->socks != NULL)
+      socket_delete(sh->socks[i]);
+    if(sh->threads != NULL)
+      evt_thread_delete(sh->threads[i]);
+  }
+  FREE(sh->socks);
+  FREE(sh->threads);
+  FREE(sh);
+}
+
+socket_ret_t socket_shards_start(socket_shards_t *sh, int backlog)
+{
+  int i;
+  CHECK_PTR_RET(sh, SOCKET_BADPARAM);
+
+  /* listen on each shard's loop, then set the loops running */
+  for(i = 0; i < sh->n; i++)
+  {
+    if(!socket_is_listening(sh->socks[i]))
+    {
+      CHECK_GOTO(socket_listen(sh->socks[i], backlog,
+                               evt_thread_loop(sh->threads[i])) == SOCKET_OK,
+                 _shards_start_1);
+    }
+  }
+
+  for(i = 0; i < sh->n; i++)
+  {
+    CHECK_GOTO(evt_thread_start(sh->threads[i]) == EVT_OK, _shards_start_1);
+  }
+
+  return SOCKET_OK;
+
+_shards_start_1:
+  socket_shards_stop(sh);
+  return SOCKET_ERROR;
+}
+
+socket_ret_t socket_shards_stop(socket_shards_t *sh)
+{
+  int i;
+  socket_ret_t ret = SOCKET_OK;
+  CHECK_PTR_RET(sh, SOCKET_BADPARAM);
+  CHECK_PTR_RET(sh->threads, SOCKET_BADPARAM);
+
+  for(i = 0; i < sh->n; i++)
+  {
+    /* fails for the shard whose thread we're on, keep stopping the rest */
+    if(evt_thread_stop(sh->threads[i]) != EVT_OK)
+      ret = SOCKET_ERROR;
+  }
+
+  return ret;
+}
+
+int socket_shards_count(socket_shards_t const *sh)
+{
+  CHECK_PTR_RET(sh, 0);
+  return sh->n;
+}
+
+socket_t * socket_shards_socket(socket_shards_t const *sh, int i)
+{
+  CHECK_PTR_RET(sh, NULL);
+  CHECK_RET((i >= 0) && (i < sh->n), NULL);
+  return sh->socks[i];
+}
+
+evt_loop_t * socket_shards_loop(socket_shards_t const *sh, int i)
+{
+  CHECK_PTR_RET(sh, NULL);
+  CHECK_RET((i >= 0) && (i < sh->n), NULL);
+  return evt_thread_loop(sh->threads[i]);
 }
 
 /* flush the socket output */
@@ -585,10 +982,63 @@ socket_ret_t socket_flush(socket_t* s)
     return aiofd_flush(s->aiofd);
 }
 
+int_t socket_set_read_buffer(socket_t *s, size_t size)
+{
+  CHECK_PTR_RET(s, FALSE);
+  CHECK_PTR_RET(s->aiofd, FALSE);
+
+  /* datagrams would run together in the buffer */
+  CHECK_RET(s->type != SOCKET_UDP, FALSE);
+
+  return aiofd_set_read_buffer(s->aiofd, size);
+}
+
+uint8_t * socket_read_buffer(socket_t *s, size_t *n)
+{
+  CHECK_PTR_RET(s, NULL);
+  return aiofd_read_buffer(s->aiofd, n);
+}
+
+int_t socket_read_consume(socket_t *s, size_t n)
+{
+  CHECK_PTR_RET(s, FALSE);
+  return aiofd_read_consume(s->aiofd, n);
+}
+
+int_t socket_pool_stats(socket_t const *s, size_t *hits, size_t *misses)
+{
+  size_t h = 0;
+  size_t m = 0;
+  CHECK_PTR_RET(s, FALSE);
+
+  /* include the aiofd's write records */
+  if(s->aiofd != NULL)
+    CHECK_RET(aiofd_pool_stats(s->aiofd, &h, &m), FALSE);
+
+  if(hits)
+    (*hits) = s->hits + h;
+  if(misses)
+    (*misses) = s->misses + m;
+  return TRUE;
+}
+
+cb_id_t socket_cb_id(socket_cb_t t)
+{
+  CHECK_RET(VALID_S_CB(t), CB_ID_INVALID);
+  pthread_once(&socket_cb_once, &s_resolve_cb_ids);
+  CHECK_RET(socket_cb_ok, CB_ID_INVALID);
+  return socket_cb_ids[t];
+}
+
 /*
  * PRIVATE
  */
 
+static void s_resolve_cb_ids(void)
+{
+  socket_cb_ok = cb_ids(socket_cb, socket_cb_ids, S_CB_COUNT);
+}
+
 static int_t s_init(socket_t *s, socket_type_t t, cb_t *cb,
                     uint8_t const *host, uint8_t const *port,
                     int ai_flags, int ai_family)
@@ -598,6 +1048,10 @@ static int_t s_init(socket_t *s, socket_type_t t, cb_t *cb,
   CHECK_PTR_RET(s, FALSE);
   CHECK_RET(VALID_SOCKET_TYPE(t), FALSE);
 
+  /* resolve the callback names to ids */
+  pthread_once(&socket_cb_once, &s_resolve_cb_ids);
+  CHECK_RET(socket_cb_ok, FALSE);
+
   MEMSET((void*)s, 0, sizeof(socket_t));
 
   s->type = t;
@@ -621,20 +1075,8 @@ static int_t s_init(socket_t *s, socket_type_t t, cb_t *cb,
   /* store the user callbacks */
   s->cb = cb;
 
-  /* hook up our internal callbacks */
-  s->int_cb = cb_new();
-  CHECK_PTR_GOTO(s->int_cb, _s_init_3);
-  ADD_READ_EVT_CB(s->int_cb, s_read_evt, s);
-  ADD_WRITE_EVT_CB(s->int_cb, s_write_evt, s);
-  ADD_ERROR_EVT_CB(s->int_cb, s_error_evt, s);
-  ADD_READ_IO_CB(s->int_cb, s_read_io, s);
-  ADD_WRITE_IO_CB(s->int_cb, s_write_io, s);
-  ADD_READV_IO_CB(s->int_cb, s_readv_io, s);
-  ADD_WRITEV_IO_CB(s->int_cb, s_writev_io, s);
-  ADD_NREAD_IO_CB(s->int_cb, s_nread_io, s);
-
-_s_init_3:
-  FREE(s->host);
+  return TRUE;
+
 _s_init_2:
   FREE(s->port);
 _s_init_1:
@@ -644,12 +1086,86 @@ _s_init_1:
 
 static void s_deinit(socket_t * s)
 {
+  write_dst_t *wd = NULL;
   CHECK_PTR(s);
   socket_disconnect(s);
   FREE(s->host);
   FREE(s->port);
-  cb_delete(s->int_cb);
   aiofd_delete(s->aiofd);
+
+  /* free the pooled write destinations */
+  while(s->pool != NULL)
+  {
+    wd = s->pool;
+    s->pool = wd->next;
+    FREE(wd);
+  }
+  s->npool = 0;
+}
+
+/* accepts up to accept_max pending connections, passing each new socket to
+ * the listener's connect callback.  stops early once the backlog is empty.
+ * a socket the callback refuses is deleted and accepting stops. */
+static void s_accept_batch(socket_t *s)
+{
+  int i;
+  socket_t *c = NULL;
+  socket_ret_t ret = SOCKET_OK;
+
+  for(i = 0; i < s->accept_max; i++)
+  {
+    c = socket_accept(s, (s->accept_cb ? s->accept_cb : s->cb), s->el);
+    if(c == NULL)
+      return;
+
+    DEBUG("calling connect callback for accepted socket %p\n", (void*)c);
+    ret = SOCKET_OK;
+    S_CONN_EVT(s->cb, c, &ret);
+    if(ret != SOCKET_OK)
+    {
+      DEBUG("stopped accepting incoming connections!\n");
+      socket_delete(c);
+
+      /* stop the read event */
+      aiofd_enable_read_evt(s->aiofd, FALSE, NULL);
+      return;
+    }
+  }
+}
+
+/* get a write destination from the pool, allocating one if it is empty */
+static write_dst_t * s_get_dst(socket_t *s)
+{
+  write_dst_t *wd = NULL;
+
+  if(s->pool != NULL)
+  {
+    wd = s->pool;
+    s->pool = wd->next;
+    s->npool--;
+    s->hits++;
+    MEMSET((void*)wd, 0, sizeof(write_dst_t));
+    return wd;
+  }
+
+  s->misses++;
+  return (write_dst_t*)CALLOC(1, sizeof(write_dst_t));
+}
+
+/* return a write destination to the pool, freeing it if the pool is full */
+static void s_put_dst(socket_t *s, write_dst_t *wd)
+{
+  CHECK_PTR(wd);
+
+  if(s->npool >= S_DST_POOL_MAX)
+  {
+    FREE(wd);
+    return;
+  }
+
+  wd->next = s->pool;
+  s->pool = wd;
+  s->npool++;
 }
 
 static int_t s_open(socket_t *s)
@@ -713,7 +1229,9 @@ static int_t s_open_tcp(socket_t * s)
 
   CHECK_PTR_RET(s, FALSE);
   CHECK_RET(s->type == SOCKET_TCP, FALSE);
-  CHECK_RET(s->port != NULL, FALSE);
+
+  /* accepted sockets already have an fd and no port string */
+  CHECK_RET((s->port != NULL) || (s->fd != -1), FALSE);
 
   /* open a socket if we don't already have one from a call to accept */
   if(s->fd == -1)
@@ -750,19 +1268,28 @@ static int_t s_open_tcp(socket_t * s)
     FREEADDRINFO(info);
   }
 
-  /* turn off TCP naggle algorithm */
-  r = SETSOCKOPT(s->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
-  CHECK_GOTO(r == 0, _open_tcp_fail_1);
-  DEBUG("turned on TCP no delay\n");
+#if defined(__linux__)
+  /* accepted sockets inherit TCP_NODELAY from the listener on linux */
+  if(!s->accepted)
+#endif
+  {
+    /* turn off TCP naggle algorithm */
+    r = SETSOCKOPT(s->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    CHECK_GOTO(r == 0, _open_tcp_fail_1);
+    DEBUG("turned on TCP no delay\n");
+  }
 
-  /* set the socket to non blocking mode */
-  flags = FCNTL(s->fd, F_GETFL);
-  r = FCNTL(s->fd, F_SETFL, (flags | O_NONBLOCK));
-  CHECK_GOTO(r != -1, _open_tcp_fail_1);
-  DEBUG("TCP socket is now non-blocking\n");
+  if(!s->accepted)
+  {
+    /* set the socket to non blocking mode */
+    flags = FCNTL(s->fd, F_GETFL);
+    r = FCNTL(s->fd, F_SETFL, (flags | O_NONBLOCK));
+    CHECK_GOTO(r != -1, _open_tcp_fail_1);
+    DEBUG("TCP socket is now non-blocking\n");
+  }
 
   /* create the aiofd */
-  s->aiofd = aiofd_new(s->fd, s->fd, s->int_cb);
+  s->aiofd = aiofd_new_ops(s->fd, s->fd, &s_aiofd_ops, s);
   CHECK_PTR_GOTO(s->aiofd, _open_tcp_fail_1);
   DEBUG("aiofd initialized\n");
 
@@ -823,10 +1350,13 @@ static int_t s_open_udp(socket_t *s)
   DEBUG("UDP socket is now non-blocking\n");
 
   /* create the aiofd */
-  s->aiofd = aiofd_new(s->fd, s->fd, s->int_cb);
+  s->aiofd = aiofd_new_ops(s->fd, s->fd, &s_aiofd_ops, s);
   CHECK_PTR_GOTO(s->aiofd, _open_udp_fail_1);
   DEBUG("aiofd initialized\n");
 
+  /* each write is its own datagram, don't let the aiofd merge them */
+  aiofd_set_datagram(s->aiofd, TRUE);
+
 #if 0
   DEBUG("UDP socket events enabled: %p\n", (void*)s);
   /* start the socket read event processing... */
@@ -876,14 +1406,17 @@ static int_t s_open_unix(socket_t * s)
     CHECK_PTR_GOTO(s->host, _open_unix_fail_1);
   }
 
-  /* set the socket to non blocking mode */
-  flags = FCNTL(s->fd, F_GETFL);
-  r = FCNTL(s->fd, F_SETFL, (flags | O_NONBLOCK));
-  CHECK_GOTO(r != -1, _open_unix_fail_1);
-  DEBUG("UNIX socket is now non-blocking\n");
+  if(!s->accepted)
+  {
+    /* set the socket to non blocking mode */
+    flags = FCNTL(s->fd, F_GETFL);
+    r = FCNTL(s->fd, F_SETFL, (flags | O_NONBLOCK));
+    CHECK_GOTO(r != -1, _open_unix_fail_1);
+    DEBUG("UNIX socket is now non-blocking\n");
+  }
 
   /* create the aiofd */
-  s->aiofd = aiofd_new(s->fd, s->fd, s->int_cb);
+  s->aiofd = aiofd_new_ops(s->fd, s->fd, &s_aiofd_ops, s);
   CHECK_PTR_GOTO(s->aiofd, _open_unix_fail_1);
   DEBUG("aiofd initialized\n");
 
@@ -1026,8 +1559,9 @@ static int_t s_get_error(socket_t *s, int *errval)
 }
 
 
-static void s_read_evt(socket_t *s, aiofd_t *a, size_t n)
+static void s_read_evt(void *ctx, aiofd_t *a, size_t n)
 {
+  socket_t *s = (socket_t*)ctx;
   socket_ret_t ret = SOCKET_OK;
   CHECK_PTR(s);
   CHECK_PTR(a);
@@ -1044,6 +1578,13 @@ static void s_read_evt(socket_t *s, aiofd_t *a, size_t n)
   {
     if(socket_is_bound(s) && socket_is_listening(s))
     {
+      if(s->accept_max > 0)
+      {
+        /* accept them ourselves */
+        s_accept_batch(s);
+        return;
+      }
+
       DEBUG("calling connect callback for incoming connection %p\n", (void*)s);
       S_CONN_EVT(s->cb, s, &ret);
       if(ret != SOCKET_OK)
@@ -1072,9 +1613,11 @@ static void s_read_evt(socket_t *s, aiofd_t *a, size_t n)
   }
 }
 
-static void s_write_evt(socket_t *s, write_dst_t *wd, aiofd_t *a, void *buf,
+static void s_write_evt(void *ctx, void *wdata, aiofd_t *a, void *buf,
                         size_t n)
 {
+  socket_t *s = (socket_t*)ctx;
+  write_dst_t *wd = (write_dst_t*)wdata;
   int errval = 0;
   socket_ret_t ret = SOCKET_OK;
   CHECK_PTR(a);
@@ -1086,8 +1629,8 @@ static void s_write_evt(socket_t *s, write_dst_t *wd, aiofd_t *a, void *buf,
   switch(s->type)
   {
     case SOCKET_UDP:
-      /* free up the struct that stored the UDP write destination */
-      FREE(wd);
+      /* return the struct that stored the UDP write destination */
+      s_put_dst(s, wd);
 
       /* call the write complete callback to let client know that a particular
       * buffer has been written to the socket. */
@@ -1163,8 +1706,9 @@ static void s_write_evt(socket_t *s, write_dst_t *wd, aiofd_t *a, void *buf,
   }
 }
 
-static void s_error_evt(socket_t *s, write_dst_t *wd, aiofd_t *a, int eno)
+static void s_error_evt(void *ctx, void *wdata, aiofd_t *a, int eno)
 {
+  socket_t *s = (socket_t*)ctx;
   CHECK_PTR(a);
   CHECK_PTR(s);
 
@@ -1172,9 +1716,10 @@ static void s_error_evt(socket_t *s, write_dst_t *wd, aiofd_t *a, int eno)
   S_ERR_EVT(s->cb, s, eno);
 }
 
-static void s_read_io(socket_t *s, aiofd_t *a, int fd, void *buf, size_t n,
+static void s_read_io(void *ctx, aiofd_t *a, int fd, void *buf, size_t n,
                       ssize_t *r)
 {
+  socket_t *s = (socket_t*)ctx;
   ssize_t ret = 0;
   if(!s)
   {
@@ -1195,9 +1740,11 @@ static void s_read_io(socket_t *s, aiofd_t *a, int fd, void *buf, size_t n,
     (*r) = ret;
 }
 
-static void s_write_io(socket_t *s, write_dst_t *wd, aiofd_t *a, int fd,
+static void s_write_io(void *ctx, void *wdata, aiofd_t *a, int fd,
                        void const *buf, size_t n, ssize_t *r)
 {
+  socket_t *s = (socket_t*)ctx;
+  write_dst_t *wd = (write_dst_t*)wdata;
   ssize_t ret = 0;
   if(!s)
   {
@@ -1221,9 +1768,10 @@ static void s_write_io(socket_t *s, write_dst_t *wd, aiofd_t *a, int fd,
     (*r) = ret;
 }
 
-static void s_readv_io(socket_t *s, aiofd_t *a, int fd, struct iovec *iov,
+static void s_readv_io(void *ctx, aiofd_t *a, int fd, struct iovec *iov,
                        size_t n, ssize_t *r)
 {
+  socket_t *s = (socket_t*)ctx;
   ssize_t ret = 0;
   struct msghdr msg;
   if(!s)
@@ -1263,9 +1811,11 @@ static void s_readv_io(socket_t *s, aiofd_t *a, int fd, struct iovec *iov,
     (*r) = ret;
 }
 
-static void s_writev_io(socket_t *s, write_dst_t *wd, aiofd_t *a, int fd,
+static void s_writev_io(void *ctx, void *wdata, aiofd_t *a, int fd,
                         struct iovec const *iov, size_t n, ssize_t *r)
 {
+  socket_t *s = (socket_t*)ctx;
+  write_dst_t *wd = (write_dst_t*)wdata;
   ssize_t ret = 0;
   struct msghdr msg;
   if(!s)
@@ -1303,9 +1853,10 @@ static void s_writev_io(socket_t *s, write_dst_t *wd, aiofd_t *a, int fd,
     (*r) = ret;
 }
 
-static void s_nread_io(socket_t *s, aiofd_t *a, int fd, size_t *n, int_t *l,
+static void s_nread_io(void *ctx, aiofd_t *a, int fd, size_t *n, int_t *l,
                        int *r)
 {
+  socket_t *s = (socket_t*)ctx;
   int ret = 0;
   size_t nread = 0;
   if(!s)
@@ -1327,12 +1878,78 @@ static void s_nread_io(socket_t *s, aiofd_t *a, int fd, size_t *n, int_t *l,
     (*r) = ret;
 }
 
+static void s_writem_io(void *ctx, aiofd_t *a, int fd, aiofd_msg_t const *msgs,
+                        size_t n, ssize_t *r)
+{
+  socket_t *s = (socket_t*)ctx;
+  write_dst_t *wd = NULL;
+  size_t i;
+  ssize_t ret = 0;
+#if defined(__linux__)
+  struct mmsghdr mm[AIOFD_MSG_MAX];
+#else
+  ssize_t w = 0;
+  struct msghdr m;
+#endif
+  if(!s || (n > AIOFD_MSG_MAX))
+  {
+    if(r)
+      (*r) = SOCKET_BADPARAM;
+    return;
+  }
+
+#if defined(__linux__)
+  MEMSET(mm, 0, n * sizeof(struct mmsghdr));
+  for(i = 0; i < n; i++)
+  {
+    /* unconnected sockets send to the queued destination */
+    wd = (write_dst_t*)msgs[i].wd;
+    mm[i].msg_hdr.msg_iov = (struct iovec *)msgs[i].iov;
+    mm[i].msg_hdr.msg_iovlen = msgs[i].iovcnt;
+    if(!socket_is_connected(s) && wd)
+    {
+      mm[i].msg_hdr.msg_name = (void*)&(wd->addr);
+      mm[i].msg_hdr.msg_namelen = wd->addrlen;
+    }
+  }
+
+  ret = SENDMMSG(fd, mm, n, 0);
+#else
+  for(i = 0; i < n; i++)
+  {
+    wd = (write_dst_t*)msgs[i].wd;
+    MEMSET(&m, 0, sizeof(struct msghdr));
+    m.msg_iov = (struct iovec *)msgs[i].iov;
+    m.msg_iovlen = msgs[i].iovcnt;
+    if(!socket_is_connected(s) && wd)
+    {
+      m.msg_name = (void*)&(wd->addr);
+      m.msg_namelen = wd->addrlen;
+    }
+
+    w = SENDMSG(fd, &m, 0);
+    if(w < 0)
+      break;
+    ret++;
+  }
+  if((ret == 0) && (w < 0))
+    ret = -1;
+#endif
+
+  if(r)
+    (*r) = ret;
+}
+
 #if defined(UNIT_TESTING)
 
 #include <CUnit/Basic.h>
 
 void test_socket_private_functions(void)
 {
+  /* the ids are resolved once and match the names */
+  CU_ASSERT_EQUAL(socket_cb_id(S_CONN_EVT), cb_id(socket_cb[S_CONN_EVT]));
+  CU_ASSERT_EQUAL(S_CB_ID(S_WRITE_EVT), cb_id(socket_cb[S_WRITE_EVT]));
+  CU_ASSERT_EQUAL(socket_cb_id(S_CB_COUNT), CB_ID_INVALID);
 }
 
 #if 0
@@ -67,10 +67,22 @@ typedef enum socket_type_e
 #define VALID_SOCKET_TYPE(t) ((t >= SOCKET_FIRST) && (t <= SOCKET_LAST))
 #define HOST_BUF_LEN (1024)
 #define PORT_BUF_LEN (8)
+#define SOCKET_MSG_MAX (64)
 
 typedef struct socket_s socket_t;
+typedef struct socket_shards_s socket_shards_t;
 typedef struct sockaddr_storage sockaddr_t;
 
+/* one datagram for socket_read_many() and socket_write_many() */
+typedef struct socket_msg_s
+{
+  struct iovec   *iov;      /* buffers to read into or data to write */
+  size_t          iovcnt;   /* number of entries in iov */
+  sockaddr_t      addr;     /* source after a read, destination for a write */
+  socklen_t       addrlen;  /* length of addr */
+  size_t          len;      /* number of bytes read */
+} socket_msg_t;
+
 /* NOTE: The connect_fn callback is used for connection based sockets (e.g.
  * TCP and Unix sockets).  For sockets that are bound and listening, it gets
  * called for each new incoming connection.  The new socket that is created
@@ -103,18 +115,21 @@ typedef enum socket_cb_e
 extern uint8_t const * const socket_cb[S_CB_COUNT];
 #define S_CB_NAME(x) (VALID_S_CB(x) ? socket_cb[x] : NULL)
 
+/* get the callback id for a socket callback, resolved once per process */
+cb_id_t socket_cb_id(socket_cb_t t);
+
 /* helper macros for declaring and adding socket callbacks */
 #define S_CONNECT_EVT_CB(fn,ctx) CB_2(fn,ctx,socket_t*,socket_ret_t*)
 #define S_DISCONNECT_EVT_CB(fn,ctx) CB_1(fn,ctx,socket_t*)
 #define S_ERROR_EVT_CB(fn,ctx) CB_2(fn,ctx,socket_t*,int)
 #define S_READ_EVT_CB(fn,ctx) CB_2(fn,ctx,socket_t*,size_t)
-#define S_WRITE_EVT_CB(fn,ctx) CB_4(fn,ctx,socket_t*,void*,size_t)
+#define S_WRITE_EVT_CB(fn,ctx) CB_3(fn,ctx,socket_t*,void*,size_t)
 
-#define S_ADD_CONNECT_EVT_CB(cb,fn,ctx) ADD_CB(cb,S_CB_NAME(S_CONN_EVT),fn,ctx)
-#define S_ADD_DISCONNECT_EVT_CB(cb,fn,ctx) ADD_CB(cb,S_CB_NAME(S_DISC_EVT),fn,ctx)
-#define S_ADD_ERROR_EVT_CB(cb,fn,ctx) ADD_CB(cb,S_CB_NAME(S_ERR_EVT),fn,ctx)
-#define S_ADD_READ_EVT_CB(cb,fn,ctx) ADD_CB(cb,S_CB_NAME(S_READ_EVT),fn,ctx)
-#define S_ADD_WRITE_EVT_CB(cb,fn,ctx) ADD_CB(cb,S_CB_NAME(S_WRITE_EVT),fn,ctx)
+#define S_ADD_CONNECT_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,socket_cb_id(S_CONN_EVT),S_CB_NAME(S_CONN_EVT),fn,ctx)
+#define S_ADD_DISCONNECT_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,socket_cb_id(S_DISC_EVT),S_CB_NAME(S_DISC_EVT),fn,ctx)
+#define S_ADD_ERROR_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,socket_cb_id(S_ERR_EVT),S_CB_NAME(S_ERR_EVT),fn,ctx)
+#define S_ADD_READ_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,socket_cb_id(S_READ_EVT),S_CB_NAME(S_READ_EVT),fn,ctx)
+#define S_ADD_WRITE_EVT_CB(cb,fn,ctx) ADD_CB_ID(cb,socket_cb_id(S_WRITE_EVT),S_CB_NAME(S_WRITE_EVT),fn,ctx)
 
 /* create/destroy a socket */
 /* NOTE: ai_flags and ai_family have the same meaning as ai_flags
@@ -137,6 +152,20 @@ socket_ret_t socket_listen(socket_t * s, int backlog, evt_loop_t *el);
 /* accept an incoming connection */
 socket_t* socket_accept(socket_t * s, cb_t *cb, evt_loop_t *el);
 
+/* set SO_REUSEPORT when the socket is bound so that several sockets can
+ * bind the same address and the kernel spreads the traffic across them */
+int_t socket_set_reuseport(socket_t *s, int_t reuse);
+
+/* accept up to max pending connections on each read event of a listening
+ * socket instead of calling the connect callback once per event.  the new
+ * sockets use cb, or the listener's callbacks if cb is NULL.  NOTE: in this
+ * mode the listener's connect callback is passed each accepted socket
+ * instead of the listener, and the callback owns it.  setting *ret to
+ * anything but SOCKET_OK refuses the connection, the accepted socket is
+ * deleted and the listener stops accepting.  a max of 0 goes back to one
+ * connect callback per event. */
+socket_ret_t socket_set_accept_batch(socket_t *s, int max, cb_t *cb);
+
 /* helper functions */
 int_t socket_addr_str(sockaddr_t const * addr, uint8_t * buf, size_t n);
 int_t socket_port_str(sockaddr_t const * addr, uint8_t * buf, size_t n);
@@ -145,6 +174,13 @@ int_t socket_is_connected(socket_t const * s);
 int_t socket_is_bound(socket_t const * s);
 int_t socket_is_listening(socket_t const * s);
 socket_type_t socket_get_type(socket_t *s);
+evt_loop_t * socket_get_loop(socket_t const *s);
+
+/* get the host and port strings.  for accepted TCP sockets these are the
+ * peer's, formatted on the first call.  to format into your own buffer use
+ * socket_addr() with socket_addr_str() and socket_port_str() instead. */
+uint8_t const * socket_get_host(socket_t *s);
+uint8_t const * socket_get_port(socket_t *s);
 
 /* socket I/O functions */
 ssize_t socket_read(socket_t *s, uint8_t *buf, size_t n);
@@ -161,4 +197,44 @@ socket_ret_t socket_writev_to(socket_t *s, struct iovec const *iov, size_t n,
                                sockaddr_t const *addr, socklen_t addrlen);
 socket_ret_t socket_flush(socket_t *s);
 
+/* read/write up to n (at most SOCKET_MSG_MAX) UDP datagrams in a single
+ * system call where the platform supports it.  return the number of
+ * datagrams moved or -1 on error.  the write goes out right away and isn't
+ * queued, the destination addresses are ignored on connected sockets. */
+ssize_t socket_read_many(socket_t *s, socket_msg_t *msgs, size_t n);
+ssize_t socket_write_many(socket_t *s, socket_msg_t const *msgs, size_t n);
+
+/* LISTENER SHARDS
+ *
+ * n TCP listeners bound to the same address with SO_REUSEPORT, each on its
+ * own event loop and thread, so that the kernel load balances incoming
+ * connections across cores.  socket_shards_start() listens on every shard
+ * and starts the threads, socket_shards_stop() breaks the loops and joins the
+ * threads, so it can't be called from the shard callbacks.  the callbacks in
+ * cb are called concurrently from all of the threads; use socket_get_loop()
+ * in the connect callback to get the loop to accept onto, or turn on
+ * socket_set_accept_batch() for each shard socket.
+ */
+socket_shards_t * socket_shards_new(int n, cb_t *cb,
+                                    uint8_t const *host, uint8_t const *port,
+                                    int ai_flags, int ai_family);
+void socket_shards_delete(void *sh);
+socket_ret_t socket_shards_start(socket_shards_t *sh, int backlog);
+socket_ret_t socket_shards_stop(socket_shards_t *sh);
+int socket_shards_count(socket_shards_t const *sh);
+socket_t * socket_shards_socket(socket_shards_t const *sh, int i);
+evt_loop_t * socket_shards_loop(socket_shards_t const *sh, int i);
+
+/* buffered reads for TCP and Unix sockets, see aiofd_set_read_buffer().  when
+ * enabled, the read callback gets the number of buffered bytes and the data
+ * is read in place with socket_read_buffer() and socket_read_consume(). */
+int_t socket_set_read_buffer(socket_t *s, size_t size);
+uint8_t * socket_read_buffer(socket_t *s, size_t *n);
+int_t socket_read_consume(socket_t *s, size_t n);
+
+/* get the number of writes that reused pooled write records (hits) and the
+ * number that had to allocate them (misses), counting both the UDP write
+ * destinations and the aiofd write records */
+int_t socket_pool_stats(socket_t const *s, size_t *hits, size_t *misses);
+
 #endif /*SOCKET_H*/
@@ -30,6 +30,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -205,6 +206,53 @@ READV_IO_CB(readv_io, int*);
 WRITEV_IO_CB(writev_io, int*, void*);
 NREAD_IO_CB(nread_io, int*);
 
+/* typed ops that forward to the same handlers */
+static void ops_read_evt(void *ctx, aiofd_t *aiofd, size_t nread)
+{
+  read_evt(&read_evts, aiofd, nread);
+}
+
+static void ops_write_evt(void *ctx, void *wd, aiofd_t *aiofd, void *buf,
+                          size_t size)
+{
+  write_evt(&write_evts, wd, aiofd, buf, size);
+}
+
+static void ops_error_evt(void *ctx, void *wd, aiofd_t *aiofd, int eno)
+{
+  error_evt(&error_evts, wd, aiofd, eno);
+}
+
+static void ops_read_io(void *ctx, aiofd_t *aiofd, int fd, void *buf,
+                        size_t n, ssize_t *res)
+{
+  read_io(&reads, aiofd, fd, buf, n, res);
+}
+
+static void ops_write_io(void *ctx, void *wd, aiofd_t *aiofd, int fd,
+                         void const *buf, size_t n, ssize_t *res)
+{
+  write_io(&writes, wd, aiofd, fd, buf, n, res);
+}
+
+static void ops_nread_io(void *ctx, aiofd_t *aiofd, int fd, size_t *nread,
+                         int_t *l, int *res)
+{
+  nread_io(&nreads, aiofd, fd, nread, l, res);
+}
+
+static aiofd_ops_t const ops =
+{
+  &ops_read_evt,
+  &ops_write_evt,
+  &ops_error_evt,
+  &ops_read_io,
+  &ops_write_io,
+  NULL,
+  NULL,
+  &ops_nread_io
+};
+
 static void test_aiofd_newdel(void)
 {
   int i;
@@ -621,6 +669,653 @@ static void test_aiofd_readv(void)
   close(fd[1]);
 }
 
+static void test_aiofd_new_ops_prereqs(void)
+{
+  aiofd_t *aiofd = NULL;
+
+  CU_ASSERT_PTR_NULL(aiofd_new_ops(-1, -1, &ops, NULL));
+  CU_ASSERT_PTR_NULL(aiofd_new_ops(fileno(stdout), -1, NULL, NULL));
+
+  aiofd = aiofd_new_ops(fileno(stdout), fileno(stdin), &ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+  aiofd_delete(aiofd);
+}
+
+static void test_aiofd_ops_write_read(void)
+{
+  aiofd_t *waiofd = NULL;
+  aiofd_t *raiofd = NULL;
+  int fd[2];
+  uint8_t *buf = UT("foo");
+  struct iovec iov;
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  waiofd = aiofd_new_ops(fd[1], -1, &ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(waiofd);
+  raiofd = aiofd_new_ops(-1, fd[0], &ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(raiofd);
+
+  write_evts = 0;
+  error_evts = 0;
+  writes = 0;
+  CU_ASSERT_TRUE(aiofd_write(waiofd, (void const*)buf, 4, NULL));
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(waiofd, TRUE, el));
+  evt_run(el);
+  CU_ASSERT_EQUAL(write_evts, 2);
+  CU_ASSERT_EQUAL(error_evts, 0);
+  CU_ASSERT_TRUE(writes > 0);
+
+  read_evts = 0;
+  nreads = 0;
+  reads = 0;
+  usev = FALSE;
+  have_read = 0;
+  to_read = 4;
+  MEMSET(gbuf, 0, BUFSIZE);
+  CU_ASSERT_TRUE(aiofd_enable_read_evt(raiofd, TRUE, el));
+  evt_run(el);
+  CU_ASSERT_EQUAL(read_evts, 1);
+  CU_ASSERT_EQUAL(error_evts, 0);
+  CU_ASSERT_TRUE(nreads > 0);
+  CU_ASSERT_TRUE(reads > 0);
+  CU_ASSERT_STRING_EQUAL("foo", gbuf);
+
+  /* a missing hook fails the call */
+  iov.iov_base = (void*)gbuf;
+  iov.iov_len = BUFSIZE;
+  CU_ASSERT_EQUAL(aiofd_readv(raiofd, &iov, 1), -1);
+
+  aiofd_delete(waiofd);
+  aiofd_delete(raiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+static void test_aiofd_write_coalesce(void)
+{
+  aiofd_t *aiofd = NULL;
+  int i, fd[2];
+  uint8_t *bufs[4] = { UT("a"), UT("bc"), UT("def"), UT("ghij") };
+  uint8_t rbuf[16];
+  struct iovec iov[2];
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  /* make sure we have a callback manager */
+  CU_ASSERT_PTR_NOT_NULL(cb);
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new(fd[1], -1, cb);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  write_evts = 0;
+  error_evts = 0;
+  writes = 0;
+  writevs = 0;
+
+  /* queue up a mix of writes and a writev */
+  for (i = 0; i < 4; i++)
+  {
+    CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)bufs[i], strlen(C(bufs[i])), NULL));
+  }
+  iov[0].iov_base = (void*)"kl";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = (void*)"m";
+  iov[1].iov_len = 1;
+  CU_ASSERT_TRUE(aiofd_writev(aiofd, iov, 2, NULL));
+
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  evt_run(el);
+
+  /* everything went out in a single writev, one completion per buffer */
+  CU_ASSERT_EQUAL(writevs, 1);
+  CU_ASSERT_EQUAL(writes, 0);
+  CU_ASSERT_EQUAL(write_evts, 6);
+  CU_ASSERT_EQUAL(error_evts, 0);
+
+  MEMSET(rbuf, 0, 16);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf, 16), 13);
+  CU_ASSERT_STRING_EQUAL(C(rbuf), "abcdefghijklm");
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+/* writev hook that only writes a couple of bytes each call */
+static void short_writev_io(void *ctx, void *wd, aiofd_t *aiofd, int fd,
+                            struct iovec const *iov, size_t n, ssize_t *res)
+{
+  struct iovec tmp = iov[0];
+  if(tmp.iov_len > 2)
+    tmp.iov_len = 2;
+  writevs++;
+  (*res) = WRITEV(fd, &tmp, 1);
+}
+
+static void short_write_evt(void *ctx, void *wd, aiofd_t *aiofd, void *buf,
+                            size_t size)
+{
+  /* completions must come in queue order */
+  if(buf != NULL)
+    CU_ASSERT_EQUAL(*((uint8_t*)buf), (uint8_t)('a' + write_evts));
+  write_evt(&write_evts, wd, aiofd, buf, size);
+}
+
+static aiofd_ops_t const short_ops =
+{
+  NULL,
+  &short_write_evt,
+  &ops_error_evt,
+  NULL,
+  NULL,
+  NULL,
+  &short_writev_io,
+  NULL
+};
+
+static void test_aiofd_write_partial(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+  uint8_t rbuf[16];
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new_ops(fd[1], -1, &short_ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  write_evts = 0;
+  error_evts = 0;
+  writevs = 0;
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"aaa", 3, NULL));
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"b", 1, NULL));
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"ccccc", 5, NULL));
+
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  evt_run(el);
+
+  /* short writes are picked up where they left off */
+  CU_ASSERT_EQUAL(write_evts, 4);
+  CU_ASSERT_EQUAL(error_evts, 0);
+  CU_ASSERT_EQUAL(writevs, 6);
+
+  MEMSET(rbuf, 0, 16);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf, 16), 9);
+  CU_ASSERT_STRING_EQUAL(C(rbuf), "aaabccccc");
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+static void test_aiofd_write_direct(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+  uint8_t rbuf[16];
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new_ops(fd[1], -1, &ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  /* let the aiofd learn the loop */
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, FALSE, NULL));
+
+  write_evts = 0;
+  error_evts = 0;
+  writes = 0;
+
+  /* the queue is empty so this goes out without running the loop */
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"hello", 5, NULL));
+  CU_ASSERT_EQUAL(writes, 1);
+
+  /* but the callbacks are left to the loop */
+  CU_ASSERT_EQUAL(write_evts, 0);
+  evt_run(el);
+  CU_ASSERT_EQUAL(writes, 1);
+  CU_ASSERT_EQUAL(write_evts, 2);
+  CU_ASSERT_EQUAL(error_evts, 0);
+
+  MEMSET(rbuf, 0, 16);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf, 16), 5);
+  CU_ASSERT_STRING_EQUAL(C(rbuf), "hello");
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+static void test_aiofd_write_direct_disable(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+  uint8_t rbuf[16];
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new_ops(fd[1], -1, &ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  /* let the aiofd learn the loop */
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, FALSE, NULL));
+
+  write_evts = 0;
+  error_evts = 0;
+  writes = 0;
+
+  /* turning the write event off before the loop runs must not lose the
+   * callbacks for the direct write */
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"hello", 5, NULL));
+  CU_ASSERT_EQUAL(writes, 1);
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, FALSE, NULL));
+  CU_ASSERT_EQUAL(write_evts, 0);
+
+  evt_run(el);
+  CU_ASSERT_EQUAL(writes, 1);
+  CU_ASSERT_EQUAL(write_evts, 2);
+  CU_ASSERT_EQUAL(error_evts, 0);
+
+  /* the record went back to the pool so the next write goes out directly */
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"!", 1, NULL));
+  CU_ASSERT_EQUAL(writes, 2);
+  evt_run(el);
+  CU_ASSERT_EQUAL(write_evts, 4);
+
+  MEMSET(rbuf, 0, 16);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf, 16), 6);
+  CU_ASSERT_STRING_EQUAL(C(rbuf), "hello!");
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+/* write hook that says the fd is full the first time it is called */
+static void eagain_write_io(void *ctx, void *wd, aiofd_t *aiofd, int fd,
+                            void const *buf, size_t n, ssize_t *res)
+{
+  writes++;
+  if(writes == 1)
+  {
+    errno = EAGAIN;
+    (*res) = -1;
+    return;
+  }
+  (*res) = WRITE(fd, buf, n);
+}
+
+static aiofd_ops_t const eagain_ops =
+{
+  NULL,
+  &ops_write_evt,
+  &ops_error_evt,
+  NULL,
+  &eagain_write_io,
+  NULL,
+  NULL,
+  NULL
+};
+
+static void test_aiofd_write_direct_eagain(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+  uint8_t rbuf[16];
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new_ops(fd[1], -1, &eagain_ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  /* let the aiofd learn the loop */
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, FALSE, NULL));
+
+  write_evts = 0;
+  error_evts = 0;
+  writes = 0;
+
+  /* the direct write would block so the write is left queued */
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"abc", 3, NULL));
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"de", 2, NULL));
+  CU_ASSERT_EQUAL(writes, 1);
+  CU_ASSERT_EQUAL(write_evts, 0);
+
+  /* the write event was started for us */
+  evt_run(el);
+
+  CU_ASSERT_EQUAL(write_evts, 3);
+  CU_ASSERT_EQUAL(error_evts, 0);
+
+  MEMSET(rbuf, 0, 16);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf, 16), 5);
+  CU_ASSERT_STRING_EQUAL(C(rbuf), "abcde");
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+/* write hook that fails as if the other end went away */
+static void epipe_write_io(void *ctx, void *wd, aiofd_t *aiofd, int fd,
+                           void const *buf, size_t n, ssize_t *res)
+{
+  writes++;
+  errno = EPIPE;
+  (*res) = -1;
+}
+
+/* error callback that deletes the aiofd like most error handlers do */
+static void delete_error_evt(void *ctx, void *wd, aiofd_t *aiofd, int eno)
+{
+  error_evts++;
+  CU_ASSERT_EQUAL(eno, EPIPE);
+  aiofd_delete(aiofd);
+  evt_stop(el, FALSE);
+}
+
+static aiofd_ops_t const epipe_ops =
+{
+  NULL,
+  &ops_write_evt,
+  &delete_error_evt,
+  NULL,
+  &epipe_write_io,
+  NULL,
+  NULL,
+  NULL
+};
+
+static void test_aiofd_write_direct_error(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new_ops(fd[1], -1, &epipe_ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  /* let the aiofd learn the loop */
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, FALSE, NULL));
+
+  write_evts = 0;
+  error_evts = 0;
+  writes = 0;
+
+  /* the direct write fails but the error is left to the loop */
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"abc", 3, NULL));
+  CU_ASSERT_EQUAL(writes, 1);
+  CU_ASSERT_EQUAL(error_evts, 0);
+
+  /* the error callback deletes the aiofd */
+  evt_run(el);
+
+  CU_ASSERT_EQUAL(writes, 1);
+  CU_ASSERT_EQUAL(write_evts, 0);
+  CU_ASSERT_EQUAL(error_evts, 1);
+
+  close(fd[0]);
+  close(fd[1]);
+}
+
+static void test_aiofd_pool_stats(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+  size_t hits = 0;
+  size_t misses = 0;
+  uint8_t rbuf[16];
+
+  CU_ASSERT_FALSE(aiofd_pool_stats(NULL, &hits, &misses));
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new_ops(fd[1], -1, &ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  CU_ASSERT_TRUE(aiofd_pool_stats(aiofd, &hits, &misses));
+  CU_ASSERT_EQUAL(hits, 0);
+  CU_ASSERT_EQUAL(misses, 0);
+
+  /* let the aiofd learn the loop so that writes complete right away */
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, FALSE, NULL));
+
+  /* the first write allocates, the rest reuse the same record */
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"a", 1, NULL));
+  evt_run(el);
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"b", 1, NULL));
+  evt_run(el);
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"c", 1, NULL));
+  evt_run(el);
+
+  CU_ASSERT_TRUE(aiofd_pool_stats(aiofd, &hits, &misses));
+  CU_ASSERT_EQUAL(hits, 2);
+  CU_ASSERT_EQUAL(misses, 1);
+
+  MEMSET(rbuf, 0, 16);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf, 16), 3);
+  CU_ASSERT_STRING_EQUAL(C(rbuf), "abc");
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+static size_t buf_nread[8];
+static uint8_t buf_out[16];
+static size_t buf_nout = 0;
+
+static void buf_read_evt(void *ctx, aiofd_t *aiofd, size_t nread)
+{
+  size_t n = 0;
+  uint8_t *p = NULL;
+
+  if(read_evts < 8)
+    buf_nread[read_evts] = nread;
+  read_evts++;
+
+  p = aiofd_read_buffer(aiofd, &n);
+  CU_ASSERT_PTR_NOT_NULL(p);
+  CU_ASSERT_EQUAL(n, nread);
+
+  /* only take part of it the first time so the buffer has to grow */
+  if(read_evts == 1)
+    n = 2;
+
+  MEMCPY(&buf_out[buf_nout], p, n);
+  buf_nout += n;
+  CU_ASSERT_TRUE(aiofd_read_consume(aiofd, n));
+
+  if(buf_nout == 11)
+  {
+    aiofd_enable_read_evt(aiofd, FALSE, NULL);
+    evt_stop(el, FALSE);
+  }
+}
+
+static aiofd_ops_t const buf_ops =
+{
+  &buf_read_evt,
+  NULL,
+  &ops_error_evt,
+  &ops_read_io,
+  NULL,
+  NULL,
+  NULL,
+  &ops_nread_io
+};
+
+static void test_aiofd_read_buffered(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+  size_t n = 0;
+
+  CU_ASSERT_FALSE(aiofd_set_read_buffer(NULL, 4));
+  CU_ASSERT_PTR_NULL(aiofd_read_buffer(NULL, &n));
+  CU_ASSERT_FALSE(aiofd_read_consume(NULL, 0));
+
+  /* open the pipe */
+  CU_ASSERT_NOT_EQUAL(pipe2(fd, O_NONBLOCK), -1);
+
+  aiofd = aiofd_new_ops(-1, fd[0], &buf_ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+
+  /* no buffer until buffered mode is turned on */
+  CU_ASSERT_PTR_NULL(aiofd_read_buffer(aiofd, &n));
+  CU_ASSERT_TRUE(aiofd_set_read_buffer(aiofd, 4));
+  CU_ASSERT_PTR_NOT_NULL(aiofd_read_buffer(aiofd, &n));
+  CU_ASSERT_EQUAL(n, 0);
+  CU_ASSERT_FALSE(aiofd_read_consume(aiofd, 1));
+
+  read_evts = 0;
+  error_evts = 0;
+  reads = 0;
+  nreads = 0;
+  buf_nout = 0;
+  MEMSET(buf_out, 0, 16);
+  MEMSET(buf_nread, 0, sizeof(buf_nread));
+  CU_ASSERT_EQUAL(write(fd[1], "hello world", 11), 11);
+
+  CU_ASSERT_TRUE(aiofd_enable_read_evt(aiofd, TRUE, el));
+  evt_run(el);
+
+  /* one read per event and no FIONREAD */
+  CU_ASSERT_EQUAL(read_evts, 3);
+  CU_ASSERT_EQUAL(reads, 3);
+  CU_ASSERT_EQUAL(nreads, 0);
+  CU_ASSERT_EQUAL(error_evts, 0);
+  CU_ASSERT_EQUAL(buf_nread[0], 4);
+  CU_ASSERT_EQUAL(buf_nread[1], 8);
+  CU_ASSERT_EQUAL(buf_nread[2], 1);
+  CU_ASSERT_STRING_EQUAL(C(buf_out), "hello world");
+
+  /* switching back frees the buffer */
+  CU_ASSERT_TRUE(aiofd_set_read_buffer(aiofd, 0));
+  CU_ASSERT_PTR_NULL(aiofd_read_buffer(aiofd, &n));
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
+static int writems = 0;
+static size_t writem_n = 0;
+
+/* sends each datagram with its own send, like a platform without sendmmsg */
+static void dgram_writem_io(void *ctx, aiofd_t *aiofd, int fd,
+                            aiofd_msg_t const *msgs, size_t n, ssize_t *res)
+{
+  size_t i;
+  writems++;
+  writem_n = n;
+  for(i = 0; i < n; i++)
+  {
+    if(WRITEV(fd, msgs[i].iov, msgs[i].iovcnt) < 0)
+      break;
+  }
+  (*res) = (i > 0) ? (ssize_t)i : -1;
+}
+
+static aiofd_ops_t const dgram_ops =
+{
+  NULL,
+  &ops_write_evt,
+  &ops_error_evt,
+  NULL,
+  &ops_write_io,
+  NULL,
+  NULL,
+  NULL,
+  &dgram_writem_io
+};
+
+static void test_aiofd_write_datagrams(void)
+{
+  aiofd_t *aiofd = NULL;
+  int fd[2];
+  uint8_t rbuf[16];
+  struct iovec iov[2];
+
+  /* make sure there is an event loop */
+  CU_ASSERT_PTR_NOT_NULL(el);
+
+  CU_ASSERT_NOT_EQUAL(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fd), -1);
+
+  aiofd = aiofd_new_ops(fd[1], -1, &dgram_ops, NULL);
+  CU_ASSERT_PTR_NOT_NULL(aiofd);
+  CU_ASSERT_TRUE(aiofd_set_datagram(aiofd, TRUE));
+
+  write_evts = 0;
+  error_evts = 0;
+  writes = 0;
+  writems = 0;
+  iov[0].iov_base = (void*)"de";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = (void*)"f";
+  iov[1].iov_len = 1;
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"a", 1, NULL));
+  CU_ASSERT_TRUE(aiofd_write(aiofd, (void const*)"bc", 2, NULL));
+  CU_ASSERT_TRUE(aiofd_writev(aiofd, iov, 2, NULL));
+
+  CU_ASSERT_TRUE(aiofd_enable_write_evt(aiofd, TRUE, el));
+  evt_run(el);
+
+  /* all three go to the hook in one call */
+  CU_ASSERT_EQUAL(writems, 1);
+  CU_ASSERT_EQUAL(writem_n, 3);
+  CU_ASSERT_EQUAL(writes, 0);
+  CU_ASSERT_EQUAL(write_evts, 4);
+  CU_ASSERT_EQUAL(error_evts, 0);
+
+  /* and the datagram boundaries are kept */
+  MEMSET(rbuf, 0, 16);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf, 16), 1);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf + 1, sizeof(rbuf) - 1), 2);
+  CU_ASSERT_EQUAL(read(fd[0], rbuf + 3, sizeof(rbuf) - 3), 3);
+  CU_ASSERT_STRING_EQUAL(C(rbuf), "abcdef");
+
+  aiofd_delete(aiofd);
+  close(fd[0]);
+  close(fd[1]);
+}
+
 static void test_aiofd_flush_null(void)
 {
   CU_ASSERT_FALSE(aiofd_flush(NULL));
@@ -670,6 +1365,17 @@ static CU_pSuite add_aiofd_tests(CU_pSuite pSuite)
   ADD_TEST("aiofd writev", test_aiofd_writev);
   ADD_TEST("aiofd readv", test_aiofd_readv);
   ADD_TEST("aiofd flush null", test_aiofd_flush_null);
+  ADD_TEST("aiofd new ops prereqs", test_aiofd_new_ops_prereqs);
+  ADD_TEST("aiofd ops write/read", test_aiofd_ops_write_read);
+  ADD_TEST("aiofd write coalesce", test_aiofd_write_coalesce);
+  ADD_TEST("aiofd write partial", test_aiofd_write_partial);
+  ADD_TEST("aiofd write direct", test_aiofd_write_direct);
+  ADD_TEST("aiofd write direct eagain", test_aiofd_write_direct_eagain);
+  ADD_TEST("aiofd write direct disable", test_aiofd_write_direct_disable);
+  ADD_TEST("aiofd write direct error", test_aiofd_write_direct_error);
+  ADD_TEST("aiofd pool stats", test_aiofd_pool_stats);
+  ADD_TEST("aiofd buffered read", test_aiofd_read_buffered);
+  ADD_TEST("aiofd write datagrams", test_aiofd_write_datagrams);
 
   ADD_TEST("test aiofd private functions", test_aiofd_private_functions);
   return pSuite;
@@ -52,6 +52,7 @@ SUITE( sanitize );
 
 SUITE( aiofd );
 SUITE( cb );
+SUITE( chashtable );
 SUITE( events );
 SUITE( hashtable );
 SUITE( list );
@@ -78,6 +79,7 @@ int main()
 
   ADD_SUITE( aiofd );
   ADD_SUITE( cb );
+  ADD_SUITE( chashtable );
   ADD_SUITE( events );
   ADD_SUITE( hashtable );
   ADD_SUITE( list );
@@ -128,6 +128,40 @@ static void test_btree_iterator( void )
 	bt_delete( (void*)bt );
 }
 
+static void test_btree_foreach( void )
+{
+	int_t i;
+	int_t prev;
+	bt_t * bt;
+	bt_itr_t itr;
+
+	bt = bt_new( 9, NULL, NULL, NULL );
+	CU_ASSERT_PTR_NOT_NULL( bt );
+
+	for ( i = 1; i < 10; i++ )
+	{
+		CU_ASSERT_EQUAL( bt_add( bt, (void*)i, (void*)(i * 2) ), TRUE );
+	}
+
+	prev = 0;
+	BT_FOREACH( bt, itr )
+	{
+		CU_ASSERT_EQUAL( (int_t)BT_ITR_GET_KEY( itr ), prev + 1 );
+		CU_ASSERT_EQUAL( BT_ITR_GET( itr ), bt_itr_get( bt, itr ) );
+		prev = (int_t)BT_ITR_GET_KEY( itr );
+	}
+	CU_ASSERT_EQUAL( prev, 9 );
+
+	BT_RFOREACH( bt, itr )
+	{
+		CU_ASSERT_EQUAL( (int_t)BT_ITR_GET( itr ), prev * 2 );
+		prev--;
+	}
+	CU_ASSERT_EQUAL( prev, 0 );
+
+	bt_delete( (void*)bt );
+}
+
 static void test_btree_random( void )
 {
 	int_t i = 0;
@@ -318,6 +352,7 @@ static CU_pSuite add_btree_tests( CU_pSuite pSuite )
 {
 	ADD_TEST( "new/delete of btree", test_btree_newdel);
 	ADD_TEST( "iteration of btree", test_btree_iterator);
+	ADD_TEST( "unchecked iteration of btree", test_btree_foreach);
 	ADD_TEST( "iteration of random btree", test_btree_random);
 	ADD_TEST( "iteration of random btree using default compare", test_btree_random_default);
 	ADD_TEST( "iteration of random btree add duplicates", test_btree_random_duplicate);
@@ -326,6 +326,86 @@ static void test_cb_context_macros(void)
   cb_delete(cb);
 }
 
+static void test_cb_id(void)
+{
+  cb_id_t foo, bar;
+  CU_ASSERT_EQUAL(cb_id(NULL), CB_ID_INVALID);
+  foo = cb_id("foo");
+  bar = cb_id("bar");
+  CU_ASSERT_NOT_EQUAL(foo, CB_ID_INVALID);
+  CU_ASSERT_NOT_EQUAL(bar, CB_ID_INVALID);
+  CU_ASSERT_NOT_EQUAL(foo, bar);
+  /* interning the same name again gives back the same id */
+  CU_ASSERT_EQUAL(cb_id("foo"), foo);
+  CU_ASSERT_EQUAL(cb_id("bar"), bar);
+}
+
+static void test_cb_ids(void)
+{
+  uint8_t const * const names[2] = { UT("foo"), UT("qux") };
+  cb_id_t ids[2] = { CB_ID_INVALID, CB_ID_INVALID };
+  CU_ASSERT_FALSE(cb_ids(NULL, ids, 2));
+  CU_ASSERT_FALSE(cb_ids(names, NULL, 2));
+  CU_ASSERT_TRUE(cb_ids(names, ids, 2));
+  CU_ASSERT_EQUAL(ids[0], cb_id("foo"));
+  CU_ASSERT_EQUAL(ids[1], cb_id("qux"));
+}
+
+static void test_cb_call_id(void)
+{
+  cb_t * cb = cb_new();
+  cb_id_t foo = cb_id("foo");
+  cb_id_t baz = cb_id("baz");
+  cb1 = 0;
+  cb2 = 0;
+  CU_ASSERT_FALSE(cb_call_id(NULL, foo));
+  CU_ASSERT_FALSE(cb_call_id(cb, CB_ID_INVALID));
+  CU_ASSERT_FALSE(cb_call_id(cb, foo));
+  CU_ASSERT_TRUE(cb_add(cb, "foo", NULL, &cb1_wrap));
+  CU_ASSERT_TRUE(cb_call_id(cb, foo));
+  CU_ASSERT_TRUE((cb1 == 1) && (cb2 == 0));
+  CU_ASSERT_TRUE(cb_add(cb, "foo", NULL, &cb2_wrap));
+  CU_ASSERT_TRUE(cb_call_id(cb, foo));
+  CU_ASSERT_TRUE((cb1 == 2) && (cb2 == 1));
+  CU_ASSERT_TRUE(cb_remove(cb, "foo", NULL, &cb1_wrap));
+  CU_ASSERT_TRUE(cb_call_id(cb, foo));
+  CU_ASSERT_TRUE((cb1 == 2) && (cb2 == 2));
+  CU_ASSERT_TRUE(cb_add(cb, "baz", NULL, &cb3_wrap));
+  CU_ASSERT_TRUE(cb_call_id(cb, baz, 3, 4));
+  CU_ASSERT_TRUE((cb1 == 3) && (cb2 == 4));
+  cb_delete(cb);
+}
+
+static void test_cb_add_id(void)
+{
+  cb_t * cb = cb_new();
+  cb_id_t foo = cb_id("foo");
+  cb1 = 0;
+  cb2 = 0;
+  CU_ASSERT_FALSE(cb_add_id(NULL, foo, "foo", NULL, &cb1_wrap));
+  CU_ASSERT_FALSE(cb_add_id(cb, CB_ID_INVALID, "foo", NULL, &cb1_wrap));
+  CU_ASSERT_FALSE(cb_add_id(cb, foo, NULL, NULL, &cb1_wrap));
+  CU_ASSERT_FALSE(cb_add_id(cb, foo, "foo", NULL, NULL));
+  CU_ASSERT_TRUE(cb_add_id(cb, foo, "foo", NULL, &cb1_wrap));
+  CU_ASSERT_FALSE(cb_add_id(cb, foo, "foo", NULL, &cb1_wrap));
+  /* callable both ways */
+  CU_ASSERT_TRUE(cb_call_id(cb, foo));
+  CU_ASSERT_TRUE(cb_call(cb, "foo"));
+  CU_ASSERT_TRUE((cb1 == 2) && (cb2 == 0));
+  cb_delete(cb);
+}
+
+static void test_cb_call_id_fail_alloc(void)
+{
+  cb_t * cb = cb_new();
+  /* a name that has never been seen needs space in the id array */
+  fail_alloc = TRUE;
+  CU_ASSERT_FALSE(cb_add(cb, "never-seen-before", NULL, &cb1_wrap));
+  fail_alloc = FALSE;
+  CU_ASSERT_FALSE(cb_has(cb, "never-seen-before"));
+  cb_delete(cb);
+}
+
 static int init_cb_suite(void)
 {
 	srand(0xDEADBEEF);
@@ -356,6 +436,11 @@ static CU_pSuite add_cb_tests(CU_pSuite pSuite)
   ADD_TEST("cb test args macros", test_cb_args_macros);
   ADD_TEST("cb test context", test_cb_context);
   ADD_TEST("cb test context macros", test_cb_context_macros);
+  ADD_TEST("cb test id", test_cb_id);
+  ADD_TEST("cb test ids", test_cb_ids);
+  ADD_TEST("cb test call id", test_cb_call_id);
+  ADD_TEST("cb test add id", test_cb_add_id);
+  ADD_TEST("cb test call id fail alloc", test_cb_call_id_fail_alloc);
 	ADD_TEST("cb private functions", test_cb_private_functions);
 
 	return pSuite;
@@ -0,0 +1,300 @@
+/* Copyright (c) 2012-2015 David Huseby
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <CUnit/Basic.h>
+
+#include <cutil/debug.h>
+#include <cutil/macros.h>
+#include <cutil/hashtable.h>
+#include <cutil/chashtable.h>
+
+#include "test_macros.h"
+#include "test_flags.h"
+
+#define NTHREADS (4)
+#define NITEMS (4096)
+
+extern void test_chashtable_private_functions(void);
+
+static uint_t hash_fn(void const * key)
+{
+	return (uint_t)key;
+}
+
+static int_t match_fn(void const * l, void const * r)
+{
+	return (int_t)((uint_t)l == (uint_t)r);
+}
+
+static int_t sum_fn(void * data, void * user)
+{
+	*((uint_t*)user) += (uint_t)data;
+	return TRUE;
+}
+
+static int_t stop_fn(void * data, void * user)
+{
+	(*((uint_t*)user))++;
+	return FALSE;
+}
+
+static void test_chashtable_newdel(void)
+{
+	cht_t * cht;
+
+	cht = cht_new(5, 100, &hash_fn, &match_fn, NULL, HT_CHAINED);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(cht);
+	CU_ASSERT_EQUAL(cht_shard_count(cht), 8);
+	CU_ASSERT_EQUAL(((uintptr_t)cht->shards) % CHT_CACHE_LINE, 0);
+	CU_ASSERT_EQUAL(sizeof(cht_shard_t) % CHT_CACHE_LINE, 0);
+	CU_ASSERT_EQUAL(cht_count(cht), 0);
+	cht_delete(cht);
+
+	cht_delete(NULL);
+}
+
+static void test_chashtable_prereqs(void)
+{
+	cht_t cht;
+
+	CU_ASSERT_FALSE(cht_init(NULL, 4, 100, &hash_fn, &match_fn, NULL, HT_CHAINED));
+	CU_ASSERT_FALSE(cht_init(&cht, 4, 100, NULL, &match_fn, NULL, HT_CHAINED));
+	CU_ASSERT_FALSE(cht_init(&cht, 4, 100, &hash_fn, NULL, NULL, HT_CHAINED));
+	CU_ASSERT_FALSE(cht_init(&cht, 0, 100, &hash_fn, &match_fn, NULL, HT_CHAINED));
+	CU_ASSERT_FALSE(cht_deinit(NULL));
+
+	CU_ASSERT_FALSE(cht_insert(NULL, (void*)1));
+	CU_ASSERT_PTR_NULL(cht_find(NULL, (void*)1));
+	CU_ASSERT_PTR_NULL(cht_remove(NULL, (void*)1));
+	CU_ASSERT_FALSE(cht_clear(NULL));
+	CU_ASSERT_FALSE(cht_foreach(NULL, &sum_fn, NULL));
+	CU_ASSERT_PTR_NULL(cht_shard_lock(NULL, 0, FALSE));
+	CU_ASSERT_EQUAL(cht_count(NULL), 0);
+	CU_ASSERT_EQUAL(cht_shard_count(NULL), 0);
+}
+
+static void test_chashtable_fail_alloc(void)
+{
+	fail_alloc = TRUE;
+	CU_ASSERT_PTR_NULL(cht_new(4, 100, &hash_fn, &match_fn, NULL, HT_CHAINED));
+	fail_alloc = FALSE;
+
+	fake_cht_init = TRUE;
+	fake_cht_init_ret = FALSE;
+	CU_ASSERT_PTR_NULL(cht_new(4, 100, &hash_fn, &match_fn, NULL, HT_CHAINED));
+	fake_cht_init = FALSE;
+
+	/* a shard failing to init unwinds the ones before it */
+	fake_ht_init = TRUE;
+	fake_ht_init_ret = FALSE;
+	CU_ASSERT_PTR_NULL(cht_new(4, 100, &hash_fn, &match_fn, NULL, HT_CHAINED));
+	fake_ht_init = FALSE;
+}
+
+static void test_chashtable_insert_find_remove(void)
+{
+	uint_t i, j, sum;
+	int_t inserted;
+	cht_t cht;
+	uint_t const flags[] = { HT_CHAINED, HT_INCREMENTAL | HT_POW2, HT_OPEN_ADDRESSED };
+
+	for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); j++)
+	{
+		CU_ASSERT_FATAL(cht_init(&cht, 16, 64, &hash_fn, &match_fn, NULL, flags[j]));
+
+		for (i = 1; i <= NITEMS; i++)
+		{
+			CU_ASSERT_TRUE(cht_insert(&cht, (void*)i));
+		}
+		CU_ASSERT_EQUAL(cht_count(&cht), NITEMS);
+
+		/* the items should be spread over all of the shards */
+		for (i = 0; i < cht_shard_count(&cht); i++)
+		{
+			CU_ASSERT_TRUE(cht_shard_lock(&cht, i, FALSE)->count > 0);
+			cht_shard_unlock(&cht, i);
+		}
+
+		for (i = 1; i <= NITEMS; i++)
+		{
+			CU_ASSERT_EQUAL(cht_find(&cht, (void*)i), (void*)i);
+		}
+		CU_ASSERT_PTR_NULL(cht_find(&cht, (void*)(NITEMS + 1)));
+		CU_ASSERT_EQUAL(cht_find_key(&cht, (void*)7, 7, &match_fn), (void*)7);
+
+		CU_ASSERT_EQUAL(cht_insert_or_get(&cht, (void*)7, &inserted), (void*)7);
+		CU_ASSERT_FALSE(inserted);
+		CU_ASSERT_EQUAL(cht_insert_or_get(&cht, (void*)(NITEMS + 1), &inserted), (void*)(NITEMS + 1));
+		CU_ASSERT_TRUE(inserted);
+		CU_ASSERT_EQUAL(cht_count(&cht), NITEMS + 1);
+
+		CU_ASSERT_EQUAL(cht_remove(&cht, (void*)(NITEMS + 1)), (void*)(NITEMS + 1));
+		CU_ASSERT_PTR_NULL(cht_remove(&cht, (void*)(NITEMS + 1)));
+		CU_ASSERT_EQUAL(cht_count(&cht), NITEMS);
+
+		sum = 0;
+		CU_ASSERT_TRUE(cht_foreach(&cht, &sum_fn, &sum));
+		CU_ASSERT_EQUAL(sum, (NITEMS * (NITEMS + 1)) / 2);
+
+		sum = 0;
+		CU_ASSERT_FALSE(cht_foreach(&cht, &stop_fn, &sum));
+		CU_ASSERT_EQUAL(sum, 1);
+
+		CU_ASSERT_TRUE(cht_clear(&cht));
+		CU_ASSERT_EQUAL(cht_count(&cht), 0);
+		CU_ASSERT_TRUE(cht_deinit(&cht));
+	}
+}
+
+static void test_chashtable_shard_lock(void)
+{
+	uint_t i, n = 0;
+	ht_t * ht;
+	ht_itr_t itr;
+	cht_t cht;
+
+	CU_ASSERT_FATAL(cht_init(&cht, 4, 64, &hash_fn, &match_fn, NULL, HT_CHAINED));
+	CU_ASSERT_PTR_NULL(cht_shard_lock(&cht, 4, FALSE));
+
+	for (i = 1; i <= 100; i++)
+	{
+		CU_ASSERT_TRUE(cht_insert(&cht, (void*)i));
+	}
+
+	for (i = 0; i < cht_shard_count(&cht); i++)
+	{
+		ht = cht_shard_lock(&cht, i, FALSE);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(ht);
+		for (itr = ht_itr_begin(ht); !ITR_EQ(itr, ht_itr_end(ht)); itr = ht_itr_next(ht, itr))
+			n++;
+		cht_shard_unlock(&cht, i);
+	}
+	CU_ASSERT_EQUAL(n, 100);
+
+	CU_ASSERT_TRUE(cht_deinit(&cht));
+}
+
+typedef struct worker_s
+{
+	cht_t * cht;
+	uint_t id;
+	uint_t found;
+} worker_t;
+
+static void * worker_main(void * arg)
+{
+	uint_t i;
+	worker_t * w = (worker_t*)arg;
+
+	/* mostly reads with a write every tenth operation */
+	for (i = 1; i <= NITEMS; i++)
+	{
+		if ((i % 10) == 0)
+			cht_insert(w->cht, (void*)((w->id * NITEMS) + i));
+		else if (cht_find(w->cht, (void*)i) != NULL)
+			w->found++;
+	}
+
+	return NULL;
+}
+
+static void test_chashtable_threads(void)
+{
+	uint_t i;
+	cht_t cht;
+	pthread_t threads[NTHREADS];
+	worker_t workers[NTHREADS];
+
+	CU_ASSERT_FATAL(cht_init(&cht, 16, NITEMS, &hash_fn, &match_fn, NULL, HT_CHAINED));
+	for (i = 1; i <= NITEMS; i++)
+	{
+		CU_ASSERT_TRUE(cht_insert(&cht, (void*)i));
+	}
+
+	for (i = 0; i < NTHREADS; i++)
+	{
+		workers[i].cht = &cht;
+		workers[i].id = i + 1;
+		workers[i].found = 0;
+		CU_ASSERT_EQUAL(pthread_create(&threads[i], NULL, &worker_main, &workers[i]), 0);
+	}
+
+	for (i = 0; i < NTHREADS; i++)
+	{
+		pthread_join(threads[i], NULL);
+		CU_ASSERT_EQUAL(workers[i].found, NITEMS - (NITEMS / 10));
+	}
+
+	CU_ASSERT_EQUAL(cht_count(&cht), NITEMS + (NTHREADS * (NITEMS / 10)));
+	CU_ASSERT_TRUE(cht_deinit(&cht));
+}
+
+static int init_chashtable_suite(void)
+{
+	srand(0xDEADBEEF);
+	reset_test_flags();
+	return 0;
+}
+
+static int deinit_chashtable_suite(void)
+{
+	reset_test_flags();
+	return 0;
+}
+
+static CU_pSuite add_chashtable_tests(CU_pSuite pSuite)
+{
+	ADD_TEST("new/delete of concurrent hashtable", test_chashtable_newdel);
+	ADD_TEST("concurrent hashtable pre-reqs", test_chashtable_prereqs);
+	ADD_TEST("concurrent hashtable fail alloc", test_chashtable_fail_alloc);
+	ADD_TEST("concurrent hashtable insert/find/remove", test_chashtable_insert_find_remove);
+	ADD_TEST("concurrent hashtable shard lock", test_chashtable_shard_lock);
+	ADD_TEST("concurrent hashtable threads", test_chashtable_threads);
+
+	ADD_TEST("concurrent hashtable private functions", test_chashtable_private_functions);
+	return pSuite;
+}
+
+CU_pSuite add_chashtable_test_suite()
+{
+	CU_pSuite pSuite = NULL;
+
+	/* add the suite to the registry */
+	pSuite = CU_add_suite("Concurrent Hashtable Tests", init_chashtable_suite, deinit_chashtable_suite);
+	CHECK_PTR_RET(pSuite, NULL);
+
+	/* add in concurrent hashtable specific tests */
+	CHECK_PTR_RET(add_chashtable_tests(pSuite), NULL);
+
+	return pSuite;
+}
+
@@ -248,6 +248,64 @@ static void test_stop_event(void)
   cb_delete(cb2);
 }
 
+static int volatile thread_reads = 0;
+static evt_ret_t volatile thread_stop_ret = EVT_OK;
+
+static void thread_io_fn(void * ctx, evt_t * evt, int fd, evt_io_type_t types)
+{
+  uint8_t c;
+
+  /* the loop's own thread can't stop it */
+  thread_stop_ret = evt_thread_stop((evt_thread_t*)ctx);
+
+  if(read(fd, &c, 1) == 1)
+    thread_reads++;
+}
+
+static void test_evt_thread(void)
+{
+  int i;
+  int fd[2];
+  evt_t * evt = NULL;
+  evt_thread_t * t = NULL;
+
+  CU_ASSERT_PTR_NULL(evt_thread_loop(NULL));
+  CU_ASSERT_EQUAL(evt_thread_start(NULL), EVT_BADPTR);
+  CU_ASSERT_EQUAL(evt_thread_stop(NULL), EVT_BADPTR);
+
+  t = evt_thread_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(t);
+  CU_ASSERT_PTR_NOT_NULL(evt_thread_loop(t));
+
+  /* stopping a thread that isn't running is fine */
+  CU_ASSERT_EQUAL(evt_thread_stop(t), EVT_OK);
+
+  CU_ASSERT_NOT_EQUAL(pipe(fd), -1);
+  evt = evt_new_io_event_fn(&thread_io_fn, t, fd[0], EVT_IO_READ);
+  CU_ASSERT_PTR_NOT_NULL(evt);
+  CU_ASSERT_EQUAL(evt_start_event(evt, evt_thread_loop(t)), EVT_OK);
+
+  thread_reads = 0;
+  CU_ASSERT_EQUAL(evt_thread_start(t), EVT_OK);
+  CU_ASSERT_EQUAL(evt_thread_start(t), EVT_ERROR);
+
+  /* the loop on the other thread picks up the write */
+  CU_ASSERT_EQUAL(write(fd[1], "x", 1), 1);
+  for(i = 0; (i < 1000) && (thread_reads == 0); i++)
+    usleep(1000);
+  CU_ASSERT_EQUAL(thread_reads, 1);
+  CU_ASSERT_EQUAL(thread_stop_ret, EVT_ERROR);
+
+  /* breaks the loop and joins the thread */
+  CU_ASSERT_EQUAL(evt_thread_stop(t), EVT_OK);
+
+  evt_stop_event(evt);
+  evt_delete_event(evt);
+  evt_thread_delete(t);
+  close(fd[0]);
+  close(fd[1]);
+}
+
 #if 0
 static void test_evt_run_null(void)
 {
@@ -283,6 +341,7 @@ static CU_pSuite add_events_tests(CU_pSuite pSuite)
   ADD_TEST("test delete event", test_delete_event);
   ADD_TEST("test start event", test_start_event);
   ADD_TEST("test stop event", test_stop_event);
+  ADD_TEST("test evt thread", test_evt_thread);
 #if 0
   ADD_TEST("test evt run null", test_evt_run_null);
   ADD_TEST("test evt stop null", test_evt_stop_null);
@@ -32,6 +32,8 @@ int_t fail_alloc = FALSE;
 /* system call flags */
 int_t fake_accept = FALSE;
 int fake_accept_ret = -1;
+int_t fake_accept4 = FALSE;
+int fake_accept4_ret = -1;
 int_t fake_bind = FALSE;
 int fake_bind_ret = -1;
 int_t fake_close = FALSE;
@@ -80,10 +82,14 @@ int_t fake_recvfrom = FALSE;
 ssize_t fake_recvfrom_ret = -1;
 int_t fake_recvmsg = FALSE;
 ssize_t fake_recvmsg_ret = -1;
+int_t fake_recvmmsg = FALSE;
+int fake_recvmmsg_ret = -1;
 int_t fake_send = FALSE;
 ssize_t fake_send_ret = -1;
 int_t fake_sendmsg = FALSE;
 ssize_t fake_sendmsg_ret = -1;
+int_t fake_sendmmsg = FALSE;
+int fake_sendmmsg_ret = -1;
 int_t fake_sendto = FALSE;
 ssize_t fake_sendto_ret = -1;
 int_t fake_setegid = FALSE;
@@ -169,6 +175,12 @@ int_t fake_ht_grow = FALSE;
 int_t fake_ht_grow_ret = FALSE;
 int_t fake_ht_find = FALSE;
 
+/* concurrent hashtable */
+int_t fake_cht_init = FALSE;
+int_t fake_cht_init_ret = FALSE;
+int_t fake_cht_deinit = FALSE;
+int_t fake_cht_deinit_ret = FALSE;
+
 /* list */
 int_t fake_list_count = FALSE;
 uint_t fake_list_count_ret = 0;
@@ -220,6 +232,8 @@ void reset_test_flags( void )
   /* system call flags */
   fake_accept = FALSE;
   fake_accept_ret = -1;
+  fake_accept4 = FALSE;
+  fake_accept4_ret = -1;
   fake_bind = FALSE;
   fake_bind_ret = -1;
   fake_close = FALSE;
@@ -325,6 +339,12 @@ void reset_test_flags( void )
   fake_ht_grow_ret = FALSE;
   fake_ht_find = FALSE;
 
+  /* concurrent hashtable */
+  fake_cht_init = FALSE;
+  fake_cht_init_ret = FALSE;
+  fake_cht_deinit = FALSE;
+  fake_cht_deinit_ret = FALSE;
+
   /* list */
   fake_list_count = FALSE;
   fake_list_count_ret = 0;
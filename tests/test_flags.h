@@ -31,6 +31,8 @@ extern int_t fail_alloc;
 /* system call flags */
 extern int_t fake_accept;
 extern int fake_accept_ret;
+extern int_t fake_accept4;
+extern int fake_accept4_ret;
 extern int_t fake_bind;
 extern int fake_bind_ret;
 extern int_t fake_connect;
@@ -77,10 +79,14 @@ extern int_t fake_recvfrom;
 extern ssize_t fake_recvfrom_ret;
 extern int_t fake_recvmsg;
 extern ssize_t fake_recvmsg_ret;
+extern int_t fake_recvmmsg;
+extern int fake_recvmmsg_ret;
 extern int_t fake_send;
 extern ssize_t fake_send_ret;
 extern int_t fake_sendmsg;
 extern ssize_t fake_sendmsg_ret;
+extern int_t fake_sendmmsg;
+extern int fake_sendmmsg_ret;
 extern int_t fake_sendto;
 extern ssize_t fake_sendto_ret;
 extern int_t fake_setegid;
@@ -166,6 +172,12 @@ extern int_t fake_ht_grow;
 extern int_t fake_ht_grow_ret;
 extern int_t fake_ht_find;
 
+/* concurrent hashtable */
+extern int_t fake_cht_init;
+extern int_t fake_cht_init_ret;
+extern int_t fake_cht_deinit;
+extern int_t fake_cht_deinit_ret;
+
 /* list */
 extern int_t fake_list_count;
 extern uint_t fake_list_count_ret;
@@ -76,7 +76,7 @@ static void test_hashtable_newdel(void)
 		CU_ASSERT_EQUAL(ht->initial, size);
 		CU_ASSERT_EQUAL(ht->count, 0);
 		CU_ASSERT_NOT_EQUAL(ht->size, 0);
-		CU_ASSERT_PTR_NOT_NULL(ht->lists);
+		CU_ASSERT_PTR_NOT_NULL(ht->heads);
 
 		ht_delete(ht);
 	}
@@ -100,7 +100,7 @@ static void test_hashtable_initdeinit(void)
 		CU_ASSERT_EQUAL(ht.initial, size);
 		CU_ASSERT_EQUAL(ht.count, 0);
 		CU_ASSERT_NOT_EQUAL(ht.size, 0);
-		CU_ASSERT_PTR_NOT_NULL(ht.lists);
+		CU_ASSERT_PTR_NOT_NULL(ht.heads);
 
 		ht_deinit(&ht);
 	}
@@ -223,10 +223,10 @@ static void test_hashtable_insert(void)
 	CU_ASSERT_TRUE(ht_clear(&ht));
 	CU_ASSERT_EQUAL(ht.count, 0);
 
-	fake_list_push = TRUE;
-	fake_list_push_ret = FALSE;
+	/* the node array can't be allocated */
+	fail_alloc = TRUE;
 	CU_ASSERT_FALSE(ht_insert(&ht, (void*)0x4));
-	fake_list_push = FALSE;
+	fail_alloc = FALSE;
 
 	CU_ASSERT_TRUE(ht_deinit(&ht));
 }
@@ -293,10 +293,10 @@ static void test_hashtable_remove(void)
 	CU_ASSERT_TRUE(ht_insert(&ht, (void*)0x4));
 	CU_ASSERT_EQUAL(ht.count, 1);
 	itr = ht_find(&ht, (void*)0x4);	
-	fake_list_get = TRUE;
-	fake_list_get_ret = NULL;
+	itr.itr++;
+	CU_ASSERT_FALSE(ht_remove(&ht, itr));
+	itr.itr = ht.nsize;
 	CU_ASSERT_FALSE(ht_remove(&ht, itr));
-	fake_list_get = FALSE;
 	CU_ASSERT_EQUAL(ht.count, 1);
 	
 	CU_ASSERT_TRUE(ht_deinit(&ht));
@@ -393,6 +393,583 @@ static void test_hashtable_empty_iterator(void)
 	}
 }
 
+static int deleted = 0;
+static void delete_fn(void * value)
+{
+	deleted++;
+}
+
+static void test_hashtable_open(void)
+{
+	int_t i, n;
+	ht_t ht;
+	ht_itr_t itr;
+	MEMSET(&ht, 0, sizeof(ht_t));
+
+	fail_alloc = TRUE;
+	CU_ASSERT_FALSE(ht_init_flags(&ht, 5, &hash_fn, &match_fn, NULL, HT_OPEN_ADDRESSED));
+	fail_alloc = FALSE;
+
+	CU_ASSERT_TRUE(ht_init_flags(&ht, 5, &hash_fn, &match_fn, &delete_fn, HT_OPEN_ADDRESSED));
+	CU_ASSERT_PTR_NULL(ht.heads);
+	CU_ASSERT_PTR_NOT_NULL(ht.ctrl);
+	CU_ASSERT_TRUE(ITR_EQ(ht_itr_begin(&ht), ht_itr_end(&ht)));
+	CU_ASSERT_TRUE(ITR_EQ(ht_find(&ht, (void*)0x4), ht_itr_end(&ht)));
+
+	/* enough to force several resizes */
+	for (i = 1; i <= 1000; i++)
+	{
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+	}
+	CU_ASSERT_FALSE(ht_insert(&ht, (void*)0x4));
+	CU_ASSERT_EQUAL(ht_count(&ht), 1000);
+
+	for (i = 1; i <= 1000; i++)
+	{
+		itr = ht_find(&ht, (void*)i);
+		CU_ASSERT_EQUAL(ht_get(&ht, itr), (void*)i);
+	}
+	CU_ASSERT_TRUE(ITR_EQ(ht_find(&ht, (void*)1001), ht_itr_end(&ht)));
+
+	/* remove the even ones */
+	for (i = 2; i <= 1000; i += 2)
+	{
+		CU_ASSERT_TRUE(ht_remove(&ht, ht_find(&ht, (void*)i)));
+	}
+	CU_ASSERT_EQUAL(ht_count(&ht), 500);
+	CU_ASSERT_FALSE(ht_remove(&ht, ht_find(&ht, (void*)0x4)));
+	CU_ASSERT_TRUE(ITR_EQ(ht_find(&ht, (void*)0x4), ht_itr_end(&ht)));
+	CU_ASSERT_EQUAL(deleted, 0);
+
+	/* iterate both ways */
+	n = 0;
+	for (itr = ht_itr_begin(&ht); !ITR_EQ(itr, ht_itr_end(&ht)); itr = ht_itr_next(&ht, itr))
+	{
+		CU_ASSERT_EQUAL((uint_t)ht_get(&ht, itr) & 1, 1);
+		n++;
+	}
+	CU_ASSERT_EQUAL(n, 500);
+	n = 0;
+	for (itr = ht_itr_rbegin(&ht); !ITR_EQ(itr, ht_itr_rend(&ht)); itr = ht_itr_rnext(&ht, itr))
+		n++;
+	CU_ASSERT_EQUAL(n, 500);
+
+	/* churn through the tombstones */
+	for (i = 0; i < 10000; i++)
+	{
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)(2000 + i)));
+		CU_ASSERT_TRUE(ht_remove(&ht, ht_find(&ht, (void*)(2000 + i))));
+	}
+	CU_ASSERT_EQUAL(ht_count(&ht), 500);
+	CU_ASSERT_TRUE(ht.size <= 2048);
+
+	itr = ht_find(&ht, (void*)0x5);
+	itr.itr = 1;
+	CU_ASSERT_PTR_NULL(ht_get(&ht, itr));
+	CU_ASSERT_FALSE(ht_remove(&ht, itr));
+
+	CU_ASSERT_TRUE(ht_clear(&ht));
+	CU_ASSERT_EQUAL(deleted, 500);
+	CU_ASSERT_EQUAL(ht.flags, HT_OPEN_ADDRESSED);
+	CU_ASSERT_TRUE(ht_insert(&ht, (void*)0x4));
+	CU_ASSERT_TRUE(ht_deinit(&ht));
+	CU_ASSERT_EQUAL(deleted, 501);
+}
+
+static void test_hashtable_incremental(void)
+{
+	int_t i, n, moving = 0;
+	ht_t ht;
+	ht_itr_t itr;
+	MEMSET(&ht, 0, sizeof(ht_t));
+
+	deleted = 0;
+	CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &hash_fn, &match_fn, &delete_fn, HT_INCREMENTAL));
+
+	for (i = 1; i <= 2000; i++)
+	{
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+		if (ht.old_heads == NULL)
+			continue;
+
+		/* everything must be reachable while buckets are being moved */
+		moving++;
+		CU_ASSERT_TRUE(ht.migrate < ht.old_size);
+		CU_ASSERT_EQUAL(ht_get(&ht, ht_find(&ht, (void*)1)), (void*)1);
+		CU_ASSERT_EQUAL(ht_get(&ht, ht_find(&ht, (void*)i)), (void*)i);
+		CU_ASSERT_FALSE(ht_insert(&ht, (void*)1));
+	}
+	CU_ASSERT_TRUE(moving > 0);
+	CU_ASSERT_EQUAL(ht_count(&ht), 2000);
+
+	/* grow again and stop part way through the move */
+	while (ht.old_heads == NULL)
+	{
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+		i++;
+	}
+	n = i - 1;
+
+	for (i = 1; i <= n; i++)
+	{
+		CU_ASSERT_EQUAL(ht_get(&ht, ht_find(&ht, (void*)i)), (void*)i);
+	}
+
+	/* iteration covers the old and new buckets */
+	i = 0;
+	for (itr = ht_itr_begin(&ht); !ITR_EQ(itr, ht_itr_end(&ht)); itr = ht_itr_next(&ht, itr))
+		i++;
+	CU_ASSERT_EQUAL(i, n);
+	i = 0;
+	for (itr = ht_itr_rbegin(&ht); !ITR_EQ(itr, ht_itr_rend(&ht)); itr = ht_itr_rnext(&ht, itr))
+		i++;
+	CU_ASSERT_EQUAL(i, n);
+
+	/* remove something that hasn't been moved yet */
+	itr = ht_find(&ht, (void*)n);
+	CU_ASSERT_TRUE(ht_remove(&ht, itr));
+	CU_ASSERT_TRUE(ITR_EQ(ht_find(&ht, (void*)n), ht_itr_end(&ht)));
+	CU_ASSERT_EQUAL(ht_count(&ht), n - 1);
+
+	/* items left in the old buckets are deleted too */
+	CU_ASSERT_TRUE(ht_deinit(&ht));
+	CU_ASSERT_EQUAL(deleted, n - 1);
+	CU_ASSERT_PTR_NULL(ht.old_heads);
+}
+
+static void test_hashtable_rehash_step(void)
+{
+	int_t i, n;
+	uint_t left;
+	ht_t ht;
+	MEMSET(&ht, 0, sizeof(ht_t));
+
+	CU_ASSERT_FALSE(ht_rehash_step(NULL, 1));
+
+	deleted = 0;
+	CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &hash_fn, &match_fn, &delete_fn, HT_INCREMENTAL));
+	CU_ASSERT_FALSE(ht_rehash_step(&ht, 1));
+
+	/* grow and stop part way through the move */
+	for (i = 1; (i <= 2000) || (ht.old_heads == NULL); i++)
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+	n = i - 1;
+
+	/* removes move buckets over too */
+	left = ht.old_size - ht.migrate;
+	CU_ASSERT_TRUE(ht_remove(&ht, ht_find(&ht, (void*)n)));
+	CU_ASSERT_TRUE((ht.old_heads == NULL) || ((ht.old_size - ht.migrate) < left));
+
+	/* a few at a time, then the rest */
+	if (ht.old_heads != NULL)
+	{
+		left = ht.old_size - ht.migrate;
+		ht_rehash_step(&ht, 1);
+		CU_ASSERT_TRUE((ht.old_heads == NULL) || ((ht.old_size - ht.migrate) == (left - 1)));
+	}
+	CU_ASSERT_FALSE(ht_rehash_step(&ht, 0));
+	CU_ASSERT_PTR_NULL(ht.old_heads);
+	CU_ASSERT_FALSE(ht_rehash_step(&ht, 1));
+
+	/* nothing was lost in the move */
+	CU_ASSERT_EQUAL(ht_count(&ht), n - 1);
+	for (i = 1; i < n; i++)
+	{
+		CU_ASSERT_EQUAL(ht_get(&ht, ht_find(&ht, (void*)i)), (void*)i);
+	}
+
+	CU_ASSERT_TRUE(ht_deinit(&ht));
+	CU_ASSERT_EQUAL(deleted, n - 1);
+}
+
+static int hashes = 0;
+static uint_t counting_hash_fn(void const * key)
+{
+	hashes++;
+	return (uint_t)key;
+}
+
+static int matches = 0;
+static int_t counting_match_fn(void const * l, void const * r)
+{
+	matches++;
+	return (int_t)((uint_t)l == (uint_t)r);
+}
+
+static void test_hashtable_cached_hash(void)
+{
+	int_t i, j;
+	ht_t ht;
+	uint_t const flags[] = { HT_CHAINED, HT_INCREMENTAL, HT_POW2,
+	                         HT_POW2 | HT_INCREMENTAL, HT_OPEN_ADDRESSED };
+
+	for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); j++)
+	{
+		MEMSET(&ht, 0, sizeof(ht_t));
+		CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &counting_hash_fn, &counting_match_fn, NULL, flags[j]));
+
+		/* resizes reuse the stored hashes */
+		hashes = 0;
+		for (i = 1; i <= 5000; i++)
+		{
+			CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+		}
+		CU_ASSERT_EQUAL(hashes, 5000);
+
+		/* only the entry with the same hash gets matched */
+		for (i = 1; i <= 5000; i++)
+		{
+			matches = 0;
+			CU_ASSERT_EQUAL(ht_get(&ht, ht_find(&ht, (void*)i)), (void*)i);
+			CU_ASSERT_EQUAL(matches, 1);
+		}
+
+		CU_ASSERT_TRUE(ht_deinit(&ht));
+	}
+}
+
+/* the key is a pointer to the value of the item */
+static int_t key_match_fn(void const * key, void const * data)
+{
+	return (int_t)(*((uint_t const *)key) == (uint_t)data);
+}
+
+static void test_hashtable_find_key(void)
+{
+	int_t j;
+	uint_t i;
+	ht_t ht;
+	ht_itr_t itr;
+	uint_t const flags[] = { HT_CHAINED, HT_INCREMENTAL, HT_POW2,
+	                         HT_POW2 | HT_INCREMENTAL, HT_OPEN_ADDRESSED };
+
+	i = 4;
+	CU_ASSERT_TRUE(ITR_EQ(ht_find_key(NULL, &i, i, &key_match_fn), ht_itr_end(NULL)));
+	CU_ASSERT_FALSE(ht_remove_key(NULL, &i, i, &key_match_fn));
+
+	for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); j++)
+	{
+		MEMSET(&ht, 0, sizeof(ht_t));
+		CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &hash_fn, &match_fn, NULL, flags[j]));
+
+		CU_ASSERT_TRUE(ITR_EQ(ht_find_key(&ht, NULL, 0, &key_match_fn), ht_itr_end(&ht)));
+		CU_ASSERT_TRUE(ITR_EQ(ht_find_key(&ht, &i, i, NULL), ht_itr_end(&ht)));
+
+		for (i = 1; i <= 500; i++)
+		{
+			CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+		}
+
+		for (i = 1; i <= 500; i++)
+		{
+			itr = ht_find_key(&ht, &i, hash_fn((void*)i), &key_match_fn);
+			CU_ASSERT_TRUE(ITR_EQ(itr, ht_find(&ht, (void*)i)));
+			CU_ASSERT_EQUAL(ht_get(&ht, itr), (void*)i);
+		}
+		i = 501;
+		CU_ASSERT_TRUE(ITR_EQ(ht_find_key(&ht, &i, i, &key_match_fn), ht_itr_end(&ht)));
+		CU_ASSERT_FALSE(ht_remove_key(&ht, &i, i, &key_match_fn));
+
+		for (i = 1; i <= 500; i += 2)
+		{
+			CU_ASSERT_TRUE(ht_remove_key(&ht, &i, i, &key_match_fn));
+		}
+		CU_ASSERT_EQUAL(ht_count(&ht), 250);
+		i = 1;
+		CU_ASSERT_TRUE(ITR_EQ(ht_find(&ht, (void*)i), ht_itr_end(&ht)));
+		i = 2;
+		CU_ASSERT_EQUAL(ht_get(&ht, ht_find_key(&ht, &i, i, &key_match_fn)), (void*)2);
+
+		CU_ASSERT_TRUE(ht_deinit(&ht));
+	}
+}
+
+static void test_hashtable_upsert(void)
+{
+	int_t i, j, inserted;
+	ht_t ht;
+	ht_itr_t itr;
+	void * old;
+	uint_t const flags[] = { HT_CHAINED, HT_INCREMENTAL, HT_POW2,
+	                         HT_POW2 | HT_INCREMENTAL, HT_OPEN_ADDRESSED };
+
+	CU_ASSERT_TRUE(ITR_EQ(ht_insert_or_get(NULL, (void*)0x4, &inserted), ht_itr_end(NULL)));
+	CU_ASSERT_FALSE(inserted);
+	CU_ASSERT_TRUE(ITR_EQ(ht_upsert(NULL, (void*)0x4, &old), ht_itr_end(NULL)));
+
+	for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); j++)
+	{
+		MEMSET(&ht, 0, sizeof(ht_t));
+		CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &counting_hash_fn, &match_fn, &delete_fn, flags[j]));
+		CU_ASSERT_TRUE(ITR_EQ(ht_insert_or_get(&ht, NULL, &inserted), ht_itr_end(&ht)));
+
+		/* one hash per call, whether or not the item was there */
+		hashes = 0;
+		for (i = 1; i <= 500; i++)
+		{
+			itr = ht_insert_or_get(&ht, (void*)i, &inserted);
+			CU_ASSERT_TRUE(inserted);
+			CU_ASSERT_EQUAL(ht_get(&ht, itr), (void*)i);
+		}
+		for (i = 1; i <= 500; i++)
+		{
+			itr = ht_insert_or_get(&ht, (void*)i, &inserted);
+			CU_ASSERT_FALSE(inserted);
+			CU_ASSERT_EQUAL(ht_get(&ht, itr), (void*)i);
+		}
+		CU_ASSERT_EQUAL(hashes, 1000);
+		CU_ASSERT_EQUAL(ht_count(&ht), 500);
+
+		/* replacing hands back the old item */
+		itr = ht_upsert(&ht, (void*)0x4, &old);
+		CU_ASSERT_EQUAL(old, (void*)0x4);
+		CU_ASSERT_EQUAL(ht_get(&ht, itr), (void*)0x4);
+		itr = ht_upsert(&ht, (void*)501, &old);
+		CU_ASSERT_PTR_NULL(old);
+		CU_ASSERT_EQUAL(ht_get(&ht, itr), (void*)501);
+		CU_ASSERT_EQUAL(ht_count(&ht), 501);
+
+		/* or deletes it if old is NULL */
+		deleted = 0;
+		itr = ht_upsert(&ht, (void*)0x5, NULL);
+		CU_ASSERT_EQUAL(deleted, 0);
+		CU_ASSERT_EQUAL(ht_count(&ht), 501);
+
+		CU_ASSERT_TRUE(ht_deinit(&ht));
+		CU_ASSERT_EQUAL(deleted, 501);
+	}
+}
+
+static void test_hashtable_pow2(void)
+{
+	int_t i;
+	ht_t ht;
+	MEMSET(&ht, 0, sizeof(ht_t));
+
+	CU_ASSERT_TRUE(ht_init_flags(&ht, 5, &hash_fn, &match_fn, NULL, HT_POW2));
+	for (i = 1; i <= 1000; i++)
+	{
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+
+		/* always a power of two */
+		CU_ASSERT_EQUAL(ht.size & (ht.size - 1), 0);
+	}
+	CU_ASSERT_TRUE(ht.size >= (1000 / 4));
+
+	for (i = 1; i <= 1000; i++)
+	{
+		CU_ASSERT_EQUAL(ht_get(&ht, ht_find(&ht, (void*)i)), (void*)i);
+	}
+
+	CU_ASSERT_TRUE(ht_deinit(&ht));
+}
+
+static void test_hashtable_nodes(void)
+{
+	int_t i;
+	uint_t nsize;
+	ht_t ht;
+	ht_itr_t itr;
+	MEMSET(&ht, 0, sizeof(ht_t));
+
+	CU_ASSERT_TRUE(ht_init(&ht, 1, &hash_fn, &match_fn, NULL));
+	CU_ASSERT_PTR_NULL(ht.nodes);
+
+	for (i = 1; i <= 100; i++)
+	{
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+	}
+	nsize = ht.nsize;
+	CU_ASSERT_TRUE(nsize >= 100);
+
+	/* new nodes are handed out in order, the rest of the array is untouched */
+	CU_ASSERT_EQUAL(ht.nnext, 100);
+	CU_ASSERT_EQUAL(ht.free, -1);
+
+	/* removed nodes get reused instead of growing the array */
+	for (i = 1; i <= 100; i++)
+	{
+		CU_ASSERT_TRUE(ht_remove(&ht, ht_find(&ht, (void*)i)));
+	}
+	CU_ASSERT_TRUE(ITR_EQ(ht_itr_begin(&ht), ht_itr_end(&ht)));
+	for (i = 101; i <= 200; i++)
+	{
+		CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+	}
+	CU_ASSERT_EQUAL(ht.nsize, nsize);
+	CU_ASSERT_EQUAL(ht.nnext, 100);
+
+	/* iteration walks the node array in order */
+	i = -1;
+	for (itr = ht_itr_begin(&ht); !ITR_EQ(itr, ht_itr_end(&ht)); itr = ht_itr_next(&ht, itr))
+	{
+		CU_ASSERT_TRUE(itr.itr > i);
+		CU_ASSERT_EQUAL(ht_get(&ht, ht_find(&ht, ht_get(&ht, itr))), ht_get(&ht, itr));
+		i = itr.itr;
+	}
+
+	CU_ASSERT_TRUE(ht_deinit(&ht));
+	CU_ASSERT_PTR_NULL(ht.nodes);
+}
+
+static void test_hashtable_sparse_iterator(void)
+{
+	int_t i, j, n;
+	ht_t ht;
+	ht_itr_t itr;
+	uint_t const flags[] = { HT_CHAINED, HT_OPEN_ADDRESSED };
+	uint_t const keep[] = { 1, 64, 65, 1000, 4999, 5000 };
+
+	for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); j++)
+	{
+		MEMSET(&ht, 0, sizeof(ht_t));
+		CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &hash_fn, &match_fn, NULL, flags[j]));
+
+		for (i = 1; i <= 5000; i++)
+		{
+			CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+		}
+
+		/* leave a handful of items spread through the table */
+		for (i = 1; i <= 5000; i++)
+		{
+			if ((i != 1) && (i != 64) && (i != 65) && (i != 1000) && (i != 4999) && (i != 5000))
+				CU_ASSERT_TRUE(ht_remove(&ht, ht_find(&ht, (void*)i)));
+		}
+		CU_ASSERT_EQUAL(ht_count(&ht), 6);
+
+		n = 0;
+		for (itr = ht_itr_begin(&ht); !ITR_EQ(itr, ht_itr_end(&ht)); itr = ht_itr_next(&ht, itr))
+		{
+			CU_ASSERT_PTR_NOT_NULL(ht_get(&ht, itr));
+			n++;
+		}
+		CU_ASSERT_EQUAL(n, 6);
+
+		n = 0;
+		for (itr = ht_itr_rbegin(&ht); !ITR_EQ(itr, ht_itr_rend(&ht)); itr = ht_itr_rnext(&ht, itr))
+		{
+			CU_ASSERT_PTR_NOT_NULL(ht_get(&ht, itr));
+			n++;
+		}
+		CU_ASSERT_EQUAL(n, 6);
+
+		for (i = 0; i < 6; i++)
+		{
+			CU_ASSERT_TRUE(ht_remove(&ht, ht_find(&ht, (void*)keep[i])));
+		}
+		CU_ASSERT_TRUE(ITR_EQ(ht_itr_begin(&ht), ht_itr_end(&ht)));
+		CU_ASSERT_TRUE(ITR_EQ(ht_itr_rbegin(&ht), ht_itr_rend(&ht)));
+
+		CU_ASSERT_TRUE(ht_deinit(&ht));
+	}
+}
+
+static void test_hashtable_find_many(void)
+{
+	int_t i, j;
+	ht_t ht;
+	void * keys[100];
+	ht_itr_t itrs[100];
+	uint_t const flags[] = { HT_CHAINED, HT_INCREMENTAL, HT_POW2, HT_OPEN_ADDRESSED };
+
+	CU_ASSERT_EQUAL(ht_find_many(NULL, keys, 100, itrs), 0);
+
+	for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); j++)
+	{
+		MEMSET(&ht, 0, sizeof(ht_t));
+		CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &hash_fn, &match_fn, NULL, flags[j]));
+		CU_ASSERT_EQUAL(ht_find_many(&ht, NULL, 100, itrs), 0);
+		CU_ASSERT_EQUAL(ht_find_many(&ht, keys, 100, NULL), 0);
+
+		for (i = 1; i <= 1000; i++)
+		{
+			CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+		}
+
+		/* every other key is missing and one is NULL */
+		for (i = 0; i < 100; i++)
+			keys[i] = (void*)((i & 1) ? (i * 10) : (5000 + i));
+		keys[99] = NULL;
+
+		CU_ASSERT_EQUAL(ht_find_many(&ht, keys, 100, itrs), 49);
+		for (i = 0; i < 100; i++)
+		{
+			if ((i & 1) && (i < 99))
+			{
+				CU_ASSERT_EQUAL(ht_get(&ht, itrs[i]), keys[i]);
+			}
+			else
+			{
+				CU_ASSERT_TRUE(ITR_EQ(itrs[i], ht_itr_end(&ht)));
+			}
+		}
+		CU_ASSERT_TRUE(ITR_EQ(itrs[99], ht_itr_end(&ht)));
+		CU_ASSERT_EQUAL(ht_find_many(&ht, keys, 1, itrs), 0);
+		CU_ASSERT_EQUAL(ht_find_many(&ht, &keys[1], 1, itrs), 1);
+
+		CU_ASSERT_TRUE(ht_deinit(&ht));
+	}
+}
+
+static void test_hashtable_foreach(void)
+{
+	int_t i, j, n;
+	uint_t cursor, sum;
+	int8_t const * citem;
+	void * item;
+	ht_t ht;
+	ht_itr_t itr;
+	uint_t const flags[] = { HT_CHAINED, HT_INCREMENTAL, HT_OPEN_ADDRESSED };
+
+	for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); j++)
+	{
+		MEMSET(&ht, 0, sizeof(ht_t));
+		CU_ASSERT_TRUE(ht_init_flags(&ht, 1, &hash_fn, &match_fn, NULL, flags[j]));
+
+		n = 0;
+		HT_FOREACH(&ht, cursor, item)
+			n++;
+		CU_ASSERT_EQUAL(n, 0);
+
+		/* leave holes so whole bitmap words and groups get skipped */
+		for (i = 1; i <= 1000; i++)
+		{
+			CU_ASSERT_TRUE(ht_insert(&ht, (void*)i));
+		}
+		sum = 0;
+		for (i = 1; i <= 1000; i++)
+		{
+			if ((i % 100) >= 3)
+			{
+				CU_ASSERT_TRUE(ht_remove(&ht, ht_find(&ht, (void*)i)));
+			}
+			else
+				sum += i;
+		}
+
+		n = 0;
+		HT_FOREACH(&ht, cursor, item)
+		{
+			n++;
+			sum -= (uint_t)item;
+		}
+		CU_ASSERT_EQUAL(n, 30);
+		CU_ASSERT_EQUAL(sum, 0);
+
+		/* typed items need no cast */
+		n = 0;
+		HT_FOREACH(&ht, cursor, citem)
+			n += (citem != NULL);
+		CU_ASSERT_EQUAL(n, 30);
+
+		itr = ht_find(&ht, (void*)201);
+		CU_ASSERT_EQUAL(HT_GET(&ht, itr), (void*)201);
+
+		CU_ASSERT_TRUE(ht_deinit(&ht));
+	}
+}
+
 static int init_hashtable_suite(void)
 {
 	srand(0xDEADBEEF);
@@ -422,6 +999,17 @@ static CU_pSuite add_hashtable_tests(CU_pSuite pSuite)
 	ADD_TEST("hashtable remove", test_hashtable_remove);
 	ADD_TEST("hashtable get", test_hashtable_get);
 	ADD_TEST("empty hashtable iterator", test_hashtable_empty_iterator);
+	ADD_TEST("open addressed hashtable", test_hashtable_open);
+	ADD_TEST("incremental hashtable resize", test_hashtable_incremental);
+	ADD_TEST("incremental hashtable rehash step", test_hashtable_rehash_step);
+	ADD_TEST("hashtable cached hashes", test_hashtable_cached_hash);
+	ADD_TEST("hashtable find by key", test_hashtable_find_key);
+	ADD_TEST("hashtable insert or get and upsert", test_hashtable_upsert);
+	ADD_TEST("power of two hashtable", test_hashtable_pow2);
+	ADD_TEST("hashtable node array", test_hashtable_nodes);
+	ADD_TEST("sparse hashtable iterator", test_hashtable_sparse_iterator);
+	ADD_TEST("hashtable find many", test_hashtable_find_many);
+	ADD_TEST("hashtable unchecked iteration", test_hashtable_foreach);
 
 	ADD_TEST("hashtable private functions", test_hashtable_private_functions);
 	return pSuite;
@@ -988,6 +988,255 @@ static void test_list_get_prereqs(void)
   CU_ASSERT_TRUE(list_deinit(&list));
 }
 
+static void test_list_grow_keeps_iterators(void)
+{
+  int_t i;
+  list_t list;
+  list_itr_t itr, mid;
+  MEMSET(&list, 0, sizeof(list_t));
+
+  CU_ASSERT_TRUE(list_init(&list, 1, NULL));
+
+  /* push while holding an iterator into the middle of the list */
+  CU_ASSERT_TRUE(list_push_tail(&list, (void*)0));
+  mid = list_itr_head(&list);
+  for (i = 1; i < 1000; i++)
+  {
+    CU_ASSERT_TRUE(list_push(&list, (void*)i, (i & 1) ? mid : list_itr_end(&list)));
+    CU_ASSERT_EQUAL(list_get(&list, mid), (void*)0);
+  }
+
+  /* growth doubles so the size is a power of two */
+  CU_ASSERT_EQUAL(list_count(&list), 1000);
+  CU_ASSERT_EQUAL(list.size, 1024);
+
+  /* the odd items went in front of mid and the even ones after it */
+  itr = list_itr_begin(&list);
+  for (i = 1; i < 1000; i += 2)
+  {
+    CU_ASSERT_EQUAL(list_get(&list, itr), (void*)i);
+    itr = list_itr_next(&list, itr);
+  }
+  CU_ASSERT_EQUAL(itr, mid);
+  for (i = 2; i < 1000; i += 2)
+  {
+    itr = list_itr_next(&list, itr);
+    CU_ASSERT_EQUAL(list_get(&list, itr), (void*)i);
+  }
+
+  /* a failed grow leaves the list alone */
+  for (i = list_count(&list); i < list.size; i++)
+  {
+    CU_ASSERT_TRUE(list_push_tail(&list, (void*)i));
+  }
+  fail_alloc = TRUE;
+  CU_ASSERT_FALSE(list_push_tail(&list, (void*)i));
+  fail_alloc = FALSE;
+  CU_ASSERT_EQUAL(list_count(&list), 1024);
+  CU_ASSERT_EQUAL(list_get(&list, mid), (void*)0);
+
+  CU_ASSERT_TRUE(list_deinit(&list));
+}
+
+static void test_list_compact_layout(void)
+{
+  int_t i;
+  list_t list;
+  list_itr_t itr;
+  MEMSET(&list, 0, sizeof(list_t));
+
+  /* the links are two 32-bit indexes */
+  CU_ASSERT_EQUAL(sizeof(list_link_t), 8);
+
+  /* fill across a few used bitmap words then empty every other node */
+  CU_ASSERT_TRUE(list_init(&list, 0, NULL));
+  for (i = 0; i < 200; i++)
+  {
+    CU_ASSERT_TRUE(list_push_tail(&list, (void*)i));
+  }
+  for (itr = list_itr_begin(&list); itr != list_itr_end(&list); itr = list_itr_next(&list, itr))
+  {
+    itr = list_pop(&list, itr);
+  }
+  CU_ASSERT_EQUAL(list_count(&list), 100);
+
+  /* the popped nodes must read as free */
+  for (i = 0; i < 200; i++)
+  {
+    if (i & 1)
+    {
+      CU_ASSERT_EQUAL(list_get(&list, i), (void*)i);
+    }
+    else
+    {
+      CU_ASSERT_PTR_NULL(list_get(&list, i));
+    }
+  }
+
+  CU_ASSERT_TRUE(list_deinit(&list));
+}
+
+static void test_list_bulk(void)
+{
+  int_t i;
+  list_t a, b;
+  list_itr_t itr;
+  void * data[64];
+  MEMSET(&a, 0, sizeof(list_t));
+  MEMSET(&b, 0, sizeof(list_t));
+
+  CU_ASSERT_TRUE(list_init(&a, 0, NULL));
+  CU_ASSERT_TRUE(list_init(&b, 0, NULL));
+
+  for (i = 0; i < 64; i++)
+    data[i] = (void*)i;
+
+  /* pre-reqs */
+  CU_ASSERT_FALSE(list_push_many(NULL, data, 64, -1));
+  CU_ASSERT_FALSE(list_push_many(&a, NULL, 64, -1));
+  CU_ASSERT_FALSE(list_push_many(&a, data, 64, 3));
+  CU_ASSERT_TRUE(list_push_many(&a, NULL, 0, -1));
+  CU_ASSERT_EQUAL(list_pop_many(NULL, 0, data, 64), 0);
+  CU_ASSERT_EQUAL(list_pop_many_head(&a, data, 64), 0);
+  CU_ASSERT_EQUAL(list_splice(&a, -1, &a, 0, 1), 0);
+  CU_ASSERT_EQUAL(list_splice(&a, -1, NULL, 0, 1), 0);
+
+  /* push 32..63 at the tail then 0..31 at the head with one grow each */
+  CU_ASSERT_TRUE(list_push_many_tail(&a, &data[32], 32));
+  CU_ASSERT_EQUAL(a.size, 32);
+  CU_ASSERT_TRUE(list_push_many_head(&a, data, 32));
+  CU_ASSERT_EQUAL(a.size, 64);
+  CU_ASSERT_EQUAL(list_count(&a), 64);
+  for (i = 0, itr = list_itr_begin(&a); itr != list_itr_end(&a); i++, itr = list_itr_next(&a, itr))
+  {
+    CU_ASSERT_EQUAL(list_get(&a, itr), (void*)i);
+  }
+
+  /* a failed grow pushes nothing */
+  fail_alloc = TRUE;
+  CU_ASSERT_FALSE(list_push_many_tail(&a, data, 1));
+  fail_alloc = FALSE;
+  CU_ASSERT_EQUAL(list_count(&a), 64);
+
+  /* move 10..19 to b */
+  itr = list_itr_begin(&a);
+  for (i = 0; i < 10; i++)
+    itr = list_itr_next(&a, itr);
+  CU_ASSERT_EQUAL(list_splice(&b, list_itr_end(&b), &a, itr, 10), 10);
+  CU_ASSERT_EQUAL(list_count(&a), 54);
+  CU_ASSERT_EQUAL(list_count(&b), 10);
+  for (i = 10, itr = list_itr_begin(&b); itr != list_itr_end(&b); i++, itr = list_itr_next(&b, itr))
+  {
+    CU_ASSERT_EQUAL(list_get(&b, itr), (void*)i);
+  }
+
+  /* splicing stops at the tail of src */
+  CU_ASSERT_EQUAL(list_splice(&b, list_itr_head(&b), &a, list_itr_tail(&a), 10), 1);
+  CU_ASSERT_EQUAL(list_get_head(&b), (void*)63);
+
+  /* pop the first 5 then ask for more than there are */
+  CU_ASSERT_EQUAL(list_pop_many_head(&a, data, 5), 5);
+  for (i = 0; i < 5; i++)
+  {
+    CU_ASSERT_EQUAL(data[i], (void*)i);
+  }
+  CU_ASSERT_EQUAL(list_pop_many_head(&a, data, 64), 48);
+  CU_ASSERT_EQUAL(data[0], (void*)5);
+  CU_ASSERT_EQUAL(data[47], (void*)62);
+  CU_ASSERT_EQUAL(list_count(&a), 0);
+
+  CU_ASSERT_TRUE(list_deinit(&a));
+  CU_ASSERT_TRUE(list_deinit(&b));
+}
+
+static void test_list_foreach(void)
+{
+  int_t i;
+  list_t list;
+  list_itr_t itr;
+  MEMSET(&list, 0, sizeof(list_t));
+
+  CU_ASSERT_TRUE(list_init(&list, 0, NULL));
+
+  /* an empty list runs no iterations */
+  i = 0;
+  LIST_FOREACH(&list, itr)
+    i++;
+  LIST_RFOREACH(&list, itr)
+    i++;
+  CU_ASSERT_EQUAL(i, 0);
+
+  for (i = 0; i < 100; i++)
+  {
+    CU_ASSERT_TRUE(list_push_tail(&list, (void*)i));
+  }
+
+  i = 0;
+  LIST_FOREACH(&list, itr)
+  {
+    CU_ASSERT_EQUAL(LIST_GET(&list, itr), (void*)i);
+    CU_ASSERT_EQUAL(LIST_ITR_NEXT(&list, itr), list_itr_next(&list, itr));
+    i++;
+  }
+  CU_ASSERT_EQUAL(i, 100);
+
+  LIST_RFOREACH(&list, itr)
+  {
+    i--;
+    CU_ASSERT_EQUAL(LIST_GET(&list, itr), (void*)i);
+    CU_ASSERT_EQUAL(LIST_ITR_RNEXT(&list, itr), list_itr_rnext(&list, itr));
+  }
+  CU_ASSERT_EQUAL(i, 0);
+
+  CU_ASSERT_TRUE(list_deinit(&list));
+}
+
+static void test_list_inline(void)
+{
+  int_t i;
+  list_t * list;
+  list_itr_t itr, first;
+
+  /* small lists don't allocate any nodes */
+  list = list_new(1, NULL);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(list);
+  fail_alloc = TRUE;
+  for (i = 0; i < LIST_INLINE; i++)
+  {
+    CU_ASSERT_TRUE(list_push_tail(list, (void*)i));
+  }
+  CU_ASSERT_EQUAL(list->links, list->inline_links);
+
+  /* spilling needs the heap */
+  CU_ASSERT_FALSE(list_push_tail(list, (void*)i));
+  fail_alloc = FALSE;
+  CU_ASSERT_EQUAL(list_count(list), LIST_INLINE);
+
+  /* iterators survive the spill */
+  first = list_itr_head(list);
+  for (i = LIST_INLINE; i < 100; i++)
+  {
+    CU_ASSERT_TRUE(list_push_tail(list, (void*)i));
+  }
+  CU_ASSERT_NOT_EQUAL(list->links, list->inline_links);
+  CU_ASSERT_EQUAL(list_get(list, first), (void*)0);
+
+  i = 0;
+  LIST_FOREACH(list, itr)
+  {
+    CU_ASSERT_EQUAL(LIST_GET(list, itr), (void*)i);
+    i++;
+  }
+  CU_ASSERT_EQUAL(i, 100);
+
+  /* clearing goes back to the inline nodes */
+  CU_ASSERT_TRUE(list_clear(list));
+  CU_ASSERT_TRUE(list_push_tail(list, (void*)1));
+  CU_ASSERT_EQUAL(list->links, list->inline_links);
+  CU_ASSERT_EQUAL(list_get_head(list), (void*)1);
+
+  list_delete(list);
+}
 
 static int init_list_suite(void)
 {
@@ -1043,6 +1292,11 @@ static CU_pSuite add_list_tests(CU_pSuite pSuite)
   ADD_TEST("list push null",        test_list_push_null);
   ADD_TEST("list pop pre-reqs",     test_list_pop_prereqs);
   ADD_TEST("list get pre-reqs",     test_list_get_prereqs);
+  ADD_TEST("list grow keeps iterators", test_list_grow_keeps_iterators);
+  ADD_TEST("list compact layout",   test_list_compact_layout);
+  ADD_TEST("list bulk push/pop/splice", test_list_bulk);
+  ADD_TEST("list unchecked iteration", test_list_foreach);
+  ADD_TEST("list inline nodes",     test_list_inline);
   ADD_TEST("list private functions",    test_list_private_functions);
 
   return pSuite;
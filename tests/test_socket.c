@@ -32,7 +32,10 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <netdb.h>
+#include <unistd.h>
 
 #include <CUnit/Basic.h>
 
@@ -99,10 +102,10 @@ static void test_socket_newdel( void )
     {
       case SOCKET_TCP:
       case SOCKET_UDP:
-        s = socket_new( type, NULL, "80", AI_PASSIVE, AF_UNSPEC, el );
+        s = socket_new( type, cb, NULL, UT("80"), AI_PASSIVE, AF_UNSPEC );
         break;
       case SOCKET_UNIX:
-        s = socket_new( type, "/tmp/blah", NULL, 0, 0, el );
+        s = socket_new( type, cb, UT("/tmp/blah"), NULL, 0, 0 );
         break;
     }
 
@@ -808,6 +811,304 @@ static void test_socket_flush( void )
 }
 #endif
 
+/* opens a plain blocking client connection to the loopback port */
+static int connect_loopback( uint16_t port )
+{
+  int fd;
+  struct sockaddr_in sin;
+
+  fd = socket( AF_INET, SOCK_STREAM, 0 );
+  CHECK_RET( fd >= 0, -1 );
+
+  MEMSET( &sin, 0, sizeof(sin) );
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons( port );
+  sin.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+  if ( connect( fd, (struct sockaddr*)&sin, sizeof(sin) ) < 0 )
+  {
+    close( fd );
+    return -1;
+  }
+
+  return fd;
+}
+
+/* same as connect_loopback over IPv6 */
+static int connect_loopback6( uint16_t port )
+{
+  int fd;
+  struct sockaddr_in6 sin6;
+
+  fd = socket( AF_INET6, SOCK_STREAM, 0 );
+  CHECK_RET( fd >= 0, -1 );
+
+  MEMSET( &sin6, 0, sizeof(sin6) );
+  sin6.sin6_family = AF_INET6;
+  sin6.sin6_port = htons( port );
+  sin6.sin6_addr = in6addr_loopback;
+  if ( connect( fd, (struct sockaddr*)&sin6, sizeof(sin6) ) < 0 )
+  {
+    close( fd );
+    return -1;
+  }
+
+  return fd;
+}
+
+/* the local port of a client fd, as the server sees it */
+static void client_port_str( int fd, char *buf, size_t n )
+{
+  sockaddr_t addr;
+  socklen_t len = sizeof(addr);
+
+  MEMSET( buf, 0, n );
+  CU_ASSERT_EQUAL( getsockname( fd, (struct sockaddr*)&addr, &len ), 0 );
+  CU_ASSERT_TRUE( socket_port_str( &addr, UT(buf), n ) );
+}
+
+static socket_t * peer_sock = NULL;
+
+static void peer_conn_cb( int *i, socket_t *s, socket_ret_t *ret )
+{
+  peer_sock = socket_accept( s, NULL, socket_get_loop( s ) );
+  evt_stop( el, FALSE );
+}
+
+S_CONNECT_EVT_CB(peer_conn_cb, int*);
+
+static void check_peer_strings( uint8_t const *host, uint8_t const *port,
+                                int family, uint8_t const *peer )
+{
+  int fd;
+  char cport[16];
+  cb_t *pcb;
+  socket_t *l, *u;
+  uint8_t const *h, *p;
+
+  pcb = cb_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL( pcb );
+  S_ADD_CONNECT_EVT_CB(pcb, peer_conn_cb, NULL);
+
+  /* an unconnected socket has the strings it was created with */
+  u = socket_new( SOCKET_TCP, pcb, host, port, 0, family );
+  CU_ASSERT_PTR_NOT_NULL_FATAL( u );
+  CU_ASSERT_STRING_EQUAL( socket_get_host( u ), host );
+  CU_ASSERT_STRING_EQUAL( socket_get_port( u ), port );
+  socket_delete( u );
+
+  l = socket_new( SOCKET_TCP, pcb, host, port, 0, family );
+  CU_ASSERT_PTR_NOT_NULL_FATAL( l );
+  CU_ASSERT_EQUAL( socket_bind( l ), SOCKET_OK );
+  CU_ASSERT_EQUAL( socket_listen( l, 8, el ), SOCKET_OK );
+
+  peer_sock = NULL;
+  fd = ( family == AF_INET6 ) ? connect_loopback6( atoi( C(port) ) )
+                              : connect_loopback( atoi( C(port) ) );
+  CU_ASSERT_FATAL( fd != -1 );
+  evt_run( el );
+  CU_ASSERT_PTR_NOT_NULL_FATAL( peer_sock );
+
+  /* the listener still has its configured strings */
+  CU_ASSERT_STRING_EQUAL( socket_get_host( l ), host );
+  CU_ASSERT_STRING_EQUAL( socket_get_port( l ), port );
+
+  /* the accepted socket formats the peer's on the first call... */
+  client_port_str( fd, cport, sizeof(cport) );
+  h = socket_get_host( peer_sock );
+  p = socket_get_port( peer_sock );
+  CU_ASSERT_PTR_NOT_NULL( h );
+  CU_ASSERT_PTR_NOT_NULL( p );
+  CU_ASSERT_STRING_EQUAL( h, peer );
+  CU_ASSERT_STRING_EQUAL( p, cport );
+
+  /* ...and hands back the same strings after that */
+  CU_ASSERT_EQUAL( socket_get_host( peer_sock ), h );
+  CU_ASSERT_EQUAL( socket_get_port( peer_sock ), p );
+
+  socket_delete( peer_sock );
+  peer_sock = NULL;
+  socket_delete( l );
+  close( fd );
+  cb_delete( pcb );
+}
+
+static void test_socket_peer_strings( void )
+{
+  CU_ASSERT_PTR_NULL( socket_get_host( NULL ) );
+  CU_ASSERT_PTR_NULL( socket_get_port( NULL ) );
+
+  check_peer_strings( UT("127.0.0.1"), UT("20519"), AF_INET, UT("127.0.0.1") );
+  check_peer_strings( UT("::1"), UT("20520"), AF_INET6, UT("::1") );
+}
+
+static socket_t * batch_socks[8];
+static int batch_nsocks = 0;
+static socket_ret_t batch_ret = SOCKET_OK;
+
+static void batch_conn_cb( int *i, socket_t *s, socket_ret_t *ret )
+{
+  if ( i )
+    (*i)++;
+
+  /* break out of the loop once this read event has been handled */
+  evt_stop( el, FALSE );
+
+  if ( batch_ret != SOCKET_OK )
+  {
+    /* refuse the connection */
+    (*ret) = batch_ret;
+    return;
+  }
+
+  CU_ASSERT_TRUE( socket_is_connected( s ) );
+  CU_ASSERT_FALSE( socket_is_listening( s ) );
+  batch_socks[batch_nsocks++] = s;
+}
+
+S_CONNECT_EVT_CB(batch_conn_cb, int*);
+
+static void test_socket_accept_batch( void )
+{
+  int i;
+  int fds[5];
+  int nconns = 0;
+  cb_t *bcb;
+  socket_t *l;
+
+  bcb = cb_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL( bcb );
+  S_ADD_CONNECT_EVT_CB(bcb, batch_conn_cb, &nconns);
+
+  l = socket_new( SOCKET_TCP, bcb, UT("127.0.0.1"), UT("20517"), 0, AF_INET );
+  CU_ASSERT_PTR_NOT_NULL_FATAL( l );
+  CU_ASSERT_EQUAL( socket_set_accept_batch( l, 2, NULL ), SOCKET_OK );
+  CU_ASSERT_EQUAL( socket_bind( l ), SOCKET_OK );
+  CU_ASSERT_EQUAL( socket_listen( l, 8, el ), SOCKET_OK );
+
+  batch_nsocks = 0;
+  batch_ret = SOCKET_OK;
+
+  /* three connections are pending when the listener wakes up */
+  for ( i = 0; i < 3; i++ )
+  {
+    fds[i] = connect_loopback( 20517 );
+    CU_ASSERT_NOT_EQUAL( fds[i], -1 );
+  }
+
+  /* one read event accepts accept_max of them */
+  evt_run( el );
+  CU_ASSERT_EQUAL( nconns, 2 );
+  CU_ASSERT_EQUAL( batch_nsocks, 2 );
+
+  /* the next one accepts the last and stops at the empty backlog */
+  evt_run( el );
+  CU_ASSERT_EQUAL( nconns, 3 );
+  CU_ASSERT_EQUAL( batch_nsocks, 3 );
+
+  for ( i = 0; i < batch_nsocks; i++ )
+    socket_delete( batch_socks[i] );
+  batch_nsocks = 0;
+
+  /* a refused connection is deleted and accepting stops */
+  batch_ret = SOCKET_ERROR;
+  fds[3] = connect_loopback( 20517 );
+  CU_ASSERT_NOT_EQUAL( fds[3], -1 );
+  evt_run( el );
+  CU_ASSERT_EQUAL( nconns, 4 );
+  CU_ASSERT_EQUAL( batch_nsocks, 0 );
+
+  fds[4] = connect_loopback( 20517 );
+  CU_ASSERT_NOT_EQUAL( fds[4], -1 );
+  evt_run( el );
+  CU_ASSERT_EQUAL( nconns, 4 );
+
+  for ( i = 0; i < 5; i++ )
+    close( fds[i] );
+  socket_delete( l );
+  cb_delete( bcb );
+}
+
+static int volatile shard_conns = 0;
+static int volatile shard_errs = 0;
+
+static void shard_conn_cb( socket_shards_t *sh, socket_t *s, socket_ret_t *ret )
+{
+  int i;
+  int found = FALSE;
+  socket_t *c;
+
+  /* the listener must be one of the shards, running on its own loop */
+  for ( i = 0; i < socket_shards_count( sh ); i++ )
+  {
+    if ( ( socket_shards_socket( sh, i ) == s ) &&
+         ( socket_shards_loop( sh, i ) == socket_get_loop( s ) ) )
+      found = TRUE;
+  }
+  if ( !found )
+    __sync_fetch_and_add( &shard_errs, 1 );
+
+  c = socket_accept( s, NULL, socket_get_loop( s ) );
+  if ( c == NULL )
+  {
+    __sync_fetch_and_add( &shard_errs, 1 );
+    return;
+  }
+
+  socket_delete( c );
+  __sync_fetch_and_add( &shard_conns, 1 );
+}
+
+S_CONNECT_EVT_CB(shard_conn_cb, socket_shards_t*);
+
+static void test_socket_shards( void )
+{
+  int i;
+  int fds[8];
+  cb_t *scb;
+  socket_shards_t *sh;
+
+  CU_ASSERT_PTR_NULL( socket_shards_new( 0, NULL, UT("127.0.0.1"), UT("20518"), 0, AF_INET ) );
+  CU_ASSERT_EQUAL( socket_shards_count( NULL ), 0 );
+  CU_ASSERT_PTR_NULL( socket_shards_socket( NULL, 0 ) );
+
+  scb = cb_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL( scb );
+
+  sh = socket_shards_new( 2, scb, UT("127.0.0.1"), UT("20518"), 0, AF_INET );
+  CU_ASSERT_PTR_NOT_NULL_FATAL( sh );
+  CU_ASSERT_EQUAL( socket_shards_count( sh ), 2 );
+  CU_ASSERT_PTR_NULL( socket_shards_socket( sh, 2 ) );
+  CU_ASSERT_PTR_NULL( socket_shards_loop( sh, -1 ) );
+  S_ADD_CONNECT_EVT_CB(scb, shard_conn_cb, sh);
+
+  shard_conns = 0;
+  shard_errs = 0;
+  CU_ASSERT_EQUAL( socket_shards_start( sh, 8 ), SOCKET_OK );
+  for ( i = 0; i < 2; i++ )
+    CU_ASSERT_TRUE( socket_is_listening( socket_shards_socket( sh, i ) ) );
+
+  /* the shard threads accept every connection */
+  for ( i = 0; i < 8; i++ )
+  {
+    fds[i] = connect_loopback( 20518 );
+    CU_ASSERT_NOT_EQUAL( fds[i], -1 );
+  }
+  for ( i = 0; ( i < 1000 ) && ( shard_conns < 8 ); i++ )
+    usleep( 1000 );
+  CU_ASSERT_EQUAL( shard_conns, 8 );
+  CU_ASSERT_EQUAL( shard_errs, 0 );
+
+  /* stopping twice is fine, then delete cleans up the stopped shards */
+  CU_ASSERT_EQUAL( socket_shards_stop( sh ), SOCKET_OK );
+  CU_ASSERT_EQUAL( socket_shards_stop( sh ), SOCKET_OK );
+  socket_shards_delete( sh );
+  socket_shards_delete( NULL );
+
+  for ( i = 0; i < 8; i++ )
+    close( fds[i] );
+  cb_delete( scb );
+}
+
 static int init_socket_suite( void )
 {
   srand(0xDEADBEEF);
@@ -831,6 +1132,9 @@ static int deinit_socket_suite( void )
 static CU_pSuite add_socket_tests( CU_pSuite pSuite )
 {
     ADD_TEST( "new/delete of socket", test_socket_newdel );
+    ADD_TEST( "socket accept batch", test_socket_accept_batch );
+    ADD_TEST( "socket peer host/port", test_socket_peer_strings );
+    ADD_TEST( "socket shards", test_socket_shards );
 #if 0
     ADD_TEST( "udp socket ping/pong", test_udp_socket );
     ADD_TEST( "tcp socket ping/pong", test_tcp_socket );